@@ -0,0 +1,137 @@
+"""
+Shared Memory Frame Reader
+--------------------------
+This script reads the decoded frames pi_webrtc exports into shared memory,
+so analytics like YOLO can run next to the stream without v4l2loopback or
+capturing the camera a second time.
+
+pi_webrtc only writes frames while a reader is attached, so the ring is
+mapped read-write: the reader refreshes its heartbeat in the header and
+registers in `waiters` while it sleeps on the futex. Run it as the same user
+(or group) as pi_webrtc, the segment is not writable by others.
+
+Usage:
+    1. Start pi_webrtc with the export enabled, e.g. 5 fps at 640x480:
+        /path/to/pi_webrtc --camera=libcamera:0 --shm_name=/pi_webrtc_frames \
+            --shm_fps=5 --shm_width=640 --shm_height=480 ...
+
+    2. Run this script:
+        python shm_reader.py /pi_webrtc_frames
+
+Requirements:
+    - Python packages: numpy, opencv-python
+"""
+
+import ctypes
+import ctypes.util
+import mmap
+import platform
+import struct
+import sys
+import time
+
+import cv2
+import numpy as np
+
+RING_HEADER = struct.Struct("<8IQ2Iq8x")  # see ShmRingHeader in shm_frame_exporter.h
+SLOT_HEADER = struct.Struct("<QQq4I3I3I")  # see ShmSlotHeader
+MAGIC = 0x46574950
+VERSION = 2
+PAGE_SIZE = 4096
+FUTEX_OFFSET = 28
+WAITERS_OFFSET = 40
+HEARTBEAT_OFFSET = 48
+
+FUTEX_WAIT = 0
+SYS_FUTEX = {"x86_64": 202, "aarch64": 98, "armv7l": 240, "armv6l": 240}.get(platform.machine())
+WAIT_TIMEOUT_NS = 100 * 1000 * 1000
+
+
+class Timespec(ctypes.Structure):
+    _fields_ = [("tv_sec", ctypes.c_long), ("tv_nsec", ctypes.c_long)]
+
+
+class Futex:
+    """Sleeps on the ring's futex, None when this platform cannot."""
+
+    def __init__(self, ring):
+        self.libc = ctypes.CDLL(ctypes.util.find_library("c"), use_errno=True)
+        # Python has no atomics of its own, other readers may update `waiters` concurrently.
+        libatomic = ctypes.CDLL(ctypes.util.find_library("atomic") or "libatomic.so.1")
+        self.atomic_add = libatomic["__atomic_fetch_add_4"]
+        self.atomic_add.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_int]
+        self.futex = ctypes.c_uint32.from_buffer(ring, FUTEX_OFFSET)
+        self.waiters = ctypes.c_uint32.from_buffer(ring, WAITERS_OFFSET)
+        self.timeout = Timespec(0, WAIT_TIMEOUT_NS)
+
+    @staticmethod
+    def open(ring):
+        if SYS_FUTEX is None:
+            return None
+        try:
+            return Futex(ring)
+        except (OSError, AttributeError):
+            return None
+
+    def wait(self, seen):
+        self.atomic_add(ctypes.byref(self.waiters), 1, 5)  # __ATOMIC_SEQ_CST
+        try:
+            # Returns at once when a frame was written since `seen` was read.
+            self.libc.syscall(ctypes.c_long(SYS_FUTEX), ctypes.byref(self.futex),
+                              ctypes.c_int(FUTEX_WAIT), ctypes.c_uint32(seen),
+                              ctypes.byref(self.timeout), None, ctypes.c_int(0))
+        finally:
+            self.atomic_add(ctypes.byref(self.waiters), 0xFFFFFFFF, 5)
+
+
+def open_ring(name):
+    with open("/dev/shm/" + name.lstrip("/"), "r+b") as f:
+        return mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ | mmap.PROT_WRITE)
+
+
+def heartbeat(ring):
+    # The writer compares it with its own CLOCK_MONOTONIC time.
+    now_us = time.clock_gettime_ns(time.CLOCK_MONOTONIC) // 1000
+    struct.pack_into("<q", ring, HEARTBEAT_OFFSET, now_us)
+
+
+def read_latest(ring, last_sequence):
+    magic, version, slot_count, slot_size, *_, latest, _, _, _ = RING_HEADER.unpack_from(ring, 0)
+    if magic != MAGIC or version != VERSION or latest == last_sequence:
+        return None, last_sequence
+
+    base = PAGE_SIZE + (latest % slot_count) * slot_size
+    lock = struct.unpack_from("<Q", ring, base)[0]
+    if lock & 1:
+        return None, last_sequence
+
+    _, sequence, timestamp_us, _, width, height, size, *_ = SLOT_HEADER.unpack_from(ring, base)
+    frame = np.frombuffer(ring, np.uint8, size, base + SLOT_HEADER.size).copy()
+
+    # The writer never waits, so the slot may have been overwritten while copying.
+    if struct.unpack_from("<Q", ring, base)[0] != lock:
+        return None, last_sequence
+    return (sequence, timestamp_us, frame.reshape(height * 3 // 2, width)), sequence
+
+
+def main():
+    ring = open_ring(sys.argv[1] if len(sys.argv) > 1 else "/pi_webrtc_frames")
+    futex = Futex.open(ring)
+    last_sequence = 0
+    while True:
+        heartbeat(ring)
+        seen = struct.unpack_from("<I", ring, FUTEX_OFFSET)[0]
+        result, last_sequence = read_latest(ring, last_sequence)
+        if result is None:
+            if futex:
+                futex.wait(seen)
+            else:
+                time.sleep(0.005)
+            continue
+        sequence, timestamp_us, yuv = result
+        bgr = cv2.cvtColor(yuv, cv2.COLOR_YUV2BGR_I420)
+        print(f"frame {sequence} at {timestamp_us} us: {bgr.shape}")
+
+
+if __name__ == "__main__":
+    main()
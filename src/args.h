@@ -10,28 +10,42 @@ struct Args {
     int fps = 30;
     int width = 640;
     int height = 480;
+    int record_width = 0;
+    int record_height = 0;
     int cameraId = 0;
     int jpeg_quality = 30;
     int rotation_angle = 0;
     int sample_rate = 44100;
     int peer_timeout = 10;
     int segment_duration = 60;
+    int record_fragment_duration = 0;
+    int buffer_count = 4;
+    int mjpeg_decode_threads = 2;
+    int mjpeg_decode_depth = 2;
+    int shm_fps = 0;
+    int shm_width = 0;
+    int shm_height = 0;
+    int shm_slots = 3;
     bool no_audio = false;
     bool hw_accel = false;
     bool use_libcamera = false;
+    bool use_file = false;
     bool use_mqtt = false;
     bool use_whep = false;
     bool use_websocket = false;
     bool fixed_resolution = false;
+    bool record_fragmented = false;
     uint32_t format = V4L2_PIX_FMT_MJPEG;
     std::string v4l2_format = "mjpeg";
     std::string camera = "libcamera:0";
+    std::string camera_file = "";
     std::string uid = "";
     std::string stun_url = "stun:stun.l.google.com:19302";
     std::string turn_url = "";
     std::string turn_username = "";
     std::string turn_password = "";
     std::string record_path = "";
+    std::string shm_name = "";
 
     // mqtt signaling
     int mqtt_port = 1883;
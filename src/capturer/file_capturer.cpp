@@ -0,0 +1,341 @@
+#include "file_capturer.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+#include "common/logging.h"
+
+// `--camera=file:testsrc` draws moving color bars instead of reading a file.
+static const char kTestPattern[] = "testsrc";
+
+// BT.601 limited range white, yellow, cyan, green, magenta, red, blue and black.
+static const uint8_t kColorBars[8][3] = {
+    {235, 128, 128}, {210, 16, 146}, {170, 166, 16}, {145, 54, 34},
+    {106, 202, 222}, {81, 90, 240},  {41, 240, 110}, {16, 128, 128},
+};
+
+std::shared_ptr<FileCapturer> FileCapturer::Create(Args args) {
+    auto ptr = std::make_shared<FileCapturer>(args);
+    ptr->Init(args.camera_file);
+    ptr->StartCapture();
+    return ptr;
+}
+
+FileCapturer::FileCapturer(Args args)
+    : fps_(args.fps),
+      width_(args.width),
+      height_(args.height),
+      hw_accel_(args.hw_accel),
+      format_(args.format),
+      config_(args),
+      data_(nullptr),
+      size_(0),
+      next_frame_(0),
+      sequence_(0) {}
+
+FileCapturer::~FileCapturer() {
+    worker_.reset();
+    mjpeg_decode_pool_.reset();
+    h264_decoder_.reset();
+    if (data_) {
+        munmap(data_, size_);
+    }
+}
+
+int FileCapturer::fps() const { return fps_; }
+
+int FileCapturer::width() const { return width_; }
+
+int FileCapturer::height() const { return height_; }
+
+bool FileCapturer::is_dma_capture() const { return false; }
+
+uint32_t FileCapturer::format() const { return format_; }
+
+Args FileCapturer::config() const { return config_; }
+
+void FileCapturer::Init(const std::string &path) {
+    if (path == kTestPattern) {
+        format_ = V4L2_PIX_FMT_YUV420;
+        INFO_PRINT("Drawing a %dx%d test pattern at %d fps", width_, height_, fps_);
+        return;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        ERROR_PRINT("Failed to open %s: %s", path.c_str(), strerror(errno));
+        exit(1);
+    }
+    size_ = st.st_size;
+    void *data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ERROR_PRINT("Failed to map %s: %s", path.c_str(), strerror(errno));
+        exit(1);
+    }
+    data_ = static_cast<uint8_t *>(data);
+
+    if (size_ > 9 && memcmp(data_, "YUV4MPEG2", 9) == 0) {
+        IndexY4m();
+    } else if (format_ == V4L2_PIX_FMT_YUV420) {
+        IndexRaw();
+    } else if (format_ == V4L2_PIX_FMT_MJPEG) {
+        IndexMjpeg();
+    } else if (format_ == V4L2_PIX_FMT_H264) {
+        IndexH264();
+    } else {
+        ERROR_PRINT("Replaying %s files is not supported.",
+                    V4L2Util::FourccToString(format_).c_str());
+        exit(1);
+    }
+
+    if (frames_.empty()) {
+        ERROR_PRINT("No frames found in %s", path.c_str());
+        exit(1);
+    }
+    INFO_PRINT("Replaying %s: %zu frames of %dx%d %s at %d fps", path.c_str(), frames_.size(),
+               width_, height_, V4L2Util::FourccToString(format_).c_str(), fps_);
+}
+
+void FileCapturer::IndexY4m() {
+    const uint8_t *end = data_ + size_;
+    const uint8_t *line_end = static_cast<const uint8_t *>(memchr(data_, '\n', size_));
+    if (!line_end) {
+        ERROR_PRINT("Invalid y4m header");
+        exit(1);
+    }
+
+    // e.g. "YUV4MPEG2 W640 H480 F30:1 Ip A1:1 C420jpeg", the frame rate is taken from `--fps`.
+    std::string header(reinterpret_cast<const char *>(data_), line_end - data_);
+    size_t pos = 0;
+    while ((pos = header.find(' ', pos)) != std::string::npos) {
+        pos++;
+        if (header[pos] == 'W') {
+            width_ = std::stoi(header.substr(pos + 1));
+        } else if (header[pos] == 'H') {
+            height_ = std::stoi(header.substr(pos + 1));
+        } else if (header[pos] == 'C' && header.compare(pos + 1, 3, "420") != 0) {
+            ERROR_PRINT("Only 4:2:0 y4m files are supported: %s", header.c_str());
+            exit(1);
+        }
+    }
+    format_ = V4L2_PIX_FMT_YUV420;
+    // Consumers size themselves from `config()`, the header wins over `--width` and `--height`.
+    config_.width = width_;
+    config_.height = height_;
+
+    const size_t frame_size = width_ * height_ + 2 * ((width_ + 1) / 2) * ((height_ + 1) / 2);
+    const uint8_t *p = line_end + 1;
+    while (p + 5 < end && memcmp(p, "FRAME", 5) == 0) {
+        p = static_cast<const uint8_t *>(memchr(p, '\n', end - p));
+        if (!p || end - (p + 1) < (ptrdiff_t)frame_size) {
+            break;
+        }
+        p++;
+        frames_.push_back({(size_t)(p - data_), frame_size, true});
+        p += frame_size;
+    }
+}
+
+void FileCapturer::IndexRaw() {
+    const size_t frame_size = width_ * height_ + 2 * ((width_ + 1) / 2) * ((height_ + 1) / 2);
+    if (size_ % frame_size != 0) {
+        ERROR_PRINT("The file is not a multiple of %dx%d i420 frames, the tail is skipped.",
+                    width_, height_);
+    }
+    for (size_t offset = 0; offset + frame_size <= size_; offset += frame_size) {
+        frames_.push_back({offset, frame_size, true});
+    }
+}
+
+void FileCapturer::IndexMjpeg() {
+    // Markers never show up in entropy coded data, 0xff is stuffed with 0x00 there.
+    size_t pos = 0;
+    while (pos + 4 <= size_) {
+        auto *soi = static_cast<uint8_t *>(memmem(data_ + pos, size_ - pos, "\xff\xd8", 2));
+        if (!soi) {
+            break;
+        }
+        size_t start = soi - data_;
+        auto *eoi = static_cast<uint8_t *>(memmem(soi + 2, size_ - start - 2, "\xff\xd9", 2));
+        if (!eoi) {
+            break;
+        }
+        size_t length = eoi + 2 - soi;
+        frames_.push_back({start, length, true});
+        pos = start + length;
+    }
+}
+
+void FileCapturer::IndexH264() {
+    auto find_start_code = [this](size_t pos) {
+        for (; pos + 3 <= size_; pos++) {
+            if (data_[pos] == 0 && data_[pos + 1] == 0 && data_[pos + 2] == 1) {
+                return pos;
+            }
+        }
+        return size_;
+    };
+
+    // Groups NAL units into access units, a new one begins with an AUD, SPS, PPS or SEI, or with
+    // a slice whose first_mb_in_slice is 0, once the current one has a slice.
+    size_t au_start = size_;
+    bool has_slice = false;
+    bool is_keyframe = false;
+    for (size_t pos = find_start_code(0); pos + 3 < size_; pos = find_start_code(pos + 3)) {
+        const size_t header = pos + 3;
+        const int nal_type = data_[header] & 0x1f;
+        const bool is_slice = nal_type == 1 || nal_type == 5;
+        const bool starts_au = (nal_type >= 6 && nal_type <= 9) ||
+                               (is_slice && header + 1 < size_ && (data_[header + 1] & 0x80));
+
+        if (has_slice && starts_au) {
+            frames_.push_back({au_start, pos - au_start, is_keyframe});
+            au_start = size_;
+            has_slice = false;
+            is_keyframe = false;
+        }
+        if (au_start == size_) {
+            au_start = pos;
+        }
+        has_slice |= is_slice;
+        is_keyframe |= nal_type == 5;
+    }
+    if (has_slice) {
+        frames_.push_back({au_start, size_ - au_start, is_keyframe});
+    }
+
+    // Every loop starts over at the first key frame, so decoders always resync.
+    while (!frames_.empty() && !frames_.front().is_keyframe) {
+        frames_.erase(frames_.begin());
+    }
+}
+
+V4L2Buffer FileCapturer::DrawTestPattern(PooledBlock &data) {
+    const int chroma_width = (width_ + 1) / 2;
+    const int chroma_height = (height_ + 1) / 2;
+    const size_t size = width_ * height_ + 2 * chroma_width * chroma_height;
+    data = frame_buffer_pool_->Acquire(size);
+
+    uint8_t *data_y = data.get();
+    uint8_t *data_u = data_y + width_ * height_;
+    uint8_t *data_v = data_u + chroma_width * chroma_height;
+    const int bar_width = std::max(width_ / 8, 1);
+    for (int x = 0; x < width_; x++) {
+        data_y[x] = kColorBars[std::min(x / bar_width, 7)][0];
+    }
+    for (int x = 0; x < chroma_width; x++) {
+        data_u[x] = kColorBars[std::min(x * 2 / bar_width, 7)][1];
+        data_v[x] = kColorBars[std::min(x * 2 / bar_width, 7)][2];
+    }
+    for (int y = 1; y < height_; y++) {
+        memcpy(data_y + y * width_, data_y, width_);
+    }
+    for (int y = 1; y < chroma_height; y++) {
+        memcpy(data_u + y * chroma_width, data_u, chroma_width);
+        memcpy(data_v + y * chroma_width, data_v, chroma_width);
+    }
+
+    // A white box sweeps across the bars, so encoders see motion in every frame.
+    const int box = std::max(std::min(width_, height_) / 8, 2) & ~1;
+    const int box_x = (sequence_ * 4) % std::max(width_ - box, 1) & ~1;
+    const int box_y = (height_ - box) / 2 & ~1;
+    for (int y = box_y; y < box_y + box; y++) {
+        memset(data_y + y * width_ + box_x, 235, box);
+    }
+    for (int y = box_y / 2; y < (box_y + box) / 2; y++) {
+        memset(data_u + y * chroma_width + box_x / 2, 128, box / 2);
+        memset(data_v + y * chroma_width + box_x / 2, 128, box / 2);
+    }
+
+    V4L2Buffer buffer(data.get(), size);
+    buffer.flags = V4L2_BUF_FLAG_KEYFRAME;
+    return buffer;
+}
+
+void FileCapturer::CaptureImage() {
+    std::this_thread::sleep_until(next_capture_time_);
+    auto now = std::chrono::steady_clock::now();
+    // Frames follow a fixed schedule, after a long stall it restarts instead of bursting.
+    next_capture_time_ += std::chrono::microseconds(1000000 / fps_);
+    if (next_capture_time_ < now) {
+        next_capture_time_ = now;
+    }
+
+    V4L2Buffer buffer;
+    PooledBlock pattern;
+    if (frames_.empty()) {
+        buffer = DrawTestPattern(pattern);
+    } else {
+        const Frame &frame = frames_[next_frame_];
+        next_frame_ = (next_frame_ + 1) % frames_.size();
+        buffer = V4L2Buffer(data_ + frame.offset, frame.length);
+        buffer.flags = frame.is_keyframe ? V4L2_BUF_FLAG_KEYFRAME : V4L2_BUF_FLAG_PFRAME;
+    }
+    buffer.inner.sequence = sequence_++;
+
+    // steady_clock is CLOCK_MONOTONIC, the clock V4L2 drivers stamp buffers with.
+    auto since_boot =
+        std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    buffer.flags |= V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC;
+    buffer.timestamp.tv_sec = since_boot / 1000000;
+    buffer.timestamp.tv_usec = since_boot % 1000000;
+
+    if (pattern) {
+        NextFrameBuffer(
+            V4L2FrameBuffer::Create(width_, height_, std::move(pattern), buffer, format_));
+        NextRawBuffer(buffer);
+        return;
+    }
+    NextBuffer(buffer);
+}
+
+void FileCapturer::NextBuffer(V4L2Buffer &buffer) {
+    if (mjpeg_decode_pool_) {
+        // Decoded only for viewers and snapshots, the recorder takes the raw buffers.
+        if (has_frame_subscribers() || has_snapshot_demand()) {
+            mjpeg_decode_pool_->Decode(V4L2FrameBuffer::Create(width_, height_, buffer, format_,
+                                                               nullptr, frame_buffer_pool_));
+        }
+    } else if (format_ == V4L2_PIX_FMT_H264 && !hw_accel_) {
+        // Every access unit is decoded, so each loop costs the same.
+        if (auto frame_buffer = h264_decoder_->Decode(buffer)) {
+            NextFrameBuffer(frame_buffer);
+        }
+    } else {
+        if (format_ == V4L2_PIX_FMT_H264 && (buffer.flags & V4L2_BUF_FLAG_KEYFRAME) &&
+            has_snapshot_demand()) {
+            if (auto frame_buffer = h264_decoder_->Decode(buffer)) {
+                PublishLatestFrame(frame_buffer);
+            }
+        }
+        NextFrameBuffer(V4L2FrameBuffer::Create(width_, height_, buffer, format_, nullptr,
+                                                frame_buffer_pool_));
+    }
+
+    NextRawBuffer(buffer);
+}
+
+void FileCapturer::StartCapture() {
+    if (format_ == V4L2_PIX_FMT_MJPEG && config_.mjpeg_decode_threads > 0) {
+        mjpeg_decode_pool_ = MjpegDecodePool::Create(
+            width_, height_, config_.mjpeg_decode_threads, config_.mjpeg_decode_depth,
+            frame_buffer_pool_, [this](rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+                NextFrameBuffer(frame_buffer);
+            });
+    } else if (format_ == V4L2_PIX_FMT_H264) {
+        h264_decoder_ = FFmpegH264Decoder::Create(width_, height_, frame_buffer_pool_);
+    }
+
+    next_capture_time_ = std::chrono::steady_clock::now();
+    worker_ = std::make_unique<Worker>("FileCapture", [this]() {
+        CaptureImage();
+    });
+    worker_->Run();
+}
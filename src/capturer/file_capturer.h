@@ -0,0 +1,66 @@
+#ifndef FILE_CAPTURER_H_
+#define FILE_CAPTURER_H_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "args.h"
+#include "capturer/video_capturer.h"
+#include "codecs/h264/ffmpeg_h264_decoder.h"
+#include "codecs/jpeg/mjpeg_decode_pool.h"
+#include "common/v4l2_frame_buffer.h"
+#include "common/worker.h"
+
+/* Replays a Y4M, raw I420, MJPEG or Annex-B H264 file in a loop, or draws a test pattern, at
+ * exactly `fps`. Frames carry the same flags and monotonic timestamps a V4L2 camera would set, so
+ * the rest of the pipeline can be benchmarked without a camera attached. */
+class FileCapturer : public VideoCapturer {
+  public:
+    static std::shared_ptr<FileCapturer> Create(Args args);
+
+    FileCapturer(Args args);
+    ~FileCapturer();
+    int fps() const override;
+    int width() const override;
+    int height() const override;
+    bool is_dma_capture() const override;
+    uint32_t format() const override;
+    Args config() const override;
+    void StartCapture() override;
+
+  private:
+    struct Frame {
+        size_t offset;
+        size_t length;
+        bool is_keyframe;
+    };
+
+    int fps_;
+    int width_;
+    int height_;
+    bool hw_accel_;
+    uint32_t format_;
+    Args config_;
+    // The whole file is mapped, so replaying never waits for the disk.
+    uint8_t *data_;
+    size_t size_;
+    std::vector<Frame> frames_;
+    size_t next_frame_;
+    uint64_t sequence_;
+    std::chrono::steady_clock::time_point next_capture_time_;
+    std::unique_ptr<Worker> worker_;
+    std::unique_ptr<MjpegDecodePool> mjpeg_decode_pool_;
+    std::unique_ptr<FFmpegH264Decoder> h264_decoder_;
+
+    void Init(const std::string &path);
+    void IndexY4m();
+    void IndexRaw();
+    void IndexMjpeg();
+    void IndexH264();
+    void CaptureImage();
+    void NextBuffer(V4L2Buffer &buffer);
+    V4L2Buffer DrawTestPattern(PooledBlock &data);
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "libcamera_capturer.h"
 
+#include <algorithm>
 #include <sys/mman.h>
 
 #include "common/logging.h"
@@ -15,9 +16,19 @@ std::shared_ptr<LibcameraCapturer> LibcameraCapturer::Create(Args args) {
 }
 
 LibcameraCapturer::LibcameraCapturer(Args args)
-    : buffer_count_(2),
+    : record_width_(0),
+      record_height_(0),
+      record_stride_(0),
+      buffer_count_(args.buffer_count),
+      dropped_frames_(0),
+      sensor_dropped_frames_(0),
+      last_sequence_(-1),
+      is_stopping_(false),
       format_(args.format),
-      config_(args) {}
+      config_(args),
+      stream_(nullptr),
+      record_stream_(nullptr),
+      completed_requests_(VIDEO_MAX_FRAME) {}
 
 void LibcameraCapturer::Init(int deviceId) {
     cm_ = std::make_unique<libcamera::CameraManager>();
@@ -39,12 +50,30 @@ void LibcameraCapturer::Init(int deviceId) {
     INFO_PRINT("camera id: %s", cam_id.c_str());
     camera_ = cm_->get(cam_id);
     camera_->acquire();
-    camera_config_ = camera_->generateConfiguration({libcamera::StreamRole::VideoRecording});
+    if (config_.record_width > 0 && config_.record_height > 0) {
+        // The ISP scales the second output for WebRTC, the first one is recorded as is.
+        camera_config_ = camera_->generateConfiguration(
+            {libcamera::StreamRole::VideoRecording, libcamera::StreamRole::Viewfinder});
+    } else {
+        camera_config_ = camera_->generateConfiguration({libcamera::StreamRole::VideoRecording});
+    }
 }
 
 LibcameraCapturer::~LibcameraCapturer() {
+    is_stopping_.store(true);
+    completed_requests_.shutdown();
+    worker_.reset();
+    if (lease_pool_) {
+        lease_pool_->Close();
+    }
+    DEBUG_PRINT("Libcamera dropped %u frames in the pipeline, %llu at the sensor.", dropped_frames_,
+                (unsigned long long)sensor_dropped_frames_);
+
     camera_->stop();
     allocator_->free(stream_);
+    if (record_stream_) {
+        allocator_->free(record_stream_);
+    }
     allocator_.reset();
     camera_config_.reset();
     camera_->release();
@@ -64,36 +93,65 @@ uint32_t LibcameraCapturer::format() const { return format_; }
 
 Args LibcameraCapturer::config() const { return config_; }
 
+bool LibcameraCapturer::has_record_stream() const { return camera_config_->size() > 1; }
+
+int LibcameraCapturer::record_width() const {
+    return has_record_stream() ? record_width_ : width_;
+}
+
+int LibcameraCapturer::record_height() const {
+    return has_record_stream() ? record_height_ : height_;
+}
+
+bool LibcameraCapturer::has_frame_lease() const { return true; }
+
+int LibcameraCapturer::StreamIndex() const { return has_record_stream() ? 1 : 0; }
+
 LibcameraCapturer &LibcameraCapturer::SetFormat(int width, int height) {
-    DEBUG_PRINT("camera original format: %s", camera_config_->at(0).toString().c_str());
+    auto &stream_config = camera_config_->at(StreamIndex());
+    DEBUG_PRINT("camera original format: %s", stream_config.toString().c_str());
 
     if (width && height) {
         libcamera::Size size(width, height);
-        camera_config_->at(0).size = size;
+        stream_config.size = size;
     }
 
-    camera_config_->at(0).pixelFormat = libcamera::formats::YUV420;
-    camera_config_->at(0).bufferCount = buffer_count_;
+    stream_config.pixelFormat = libcamera::formats::YUV420;
+    stream_config.bufferCount = buffer_count_;
+
+    if (has_record_stream()) {
+        auto &record_config = camera_config_->at(0);
+        record_config.size = libcamera::Size(config_.record_width, config_.record_height);
+        record_config.pixelFormat = libcamera::formats::YUV420;
+        record_config.bufferCount = buffer_count_;
+    }
 
     auto validation = camera_config_->validate();
     if (validation == libcamera::CameraConfiguration::Status::Valid) {
-        INFO_PRINT("camera validated format: %s.", camera_config_->at(0).toString().c_str());
+        INFO_PRINT("camera validated format: %s.", stream_config.toString().c_str());
     } else if (validation == libcamera::CameraConfiguration::Status::Adjusted) {
-        INFO_PRINT("camera adjusted format: %s.", camera_config_->at(0).toString().c_str());
+        INFO_PRINT("camera adjusted format: %s.", stream_config.toString().c_str());
     } else {
         ERROR_PRINT("Failed to validate camera configuration.");
         exit(1);
     }
 
-    width_ = camera_config_->at(0).size.width;
-    height_ = camera_config_->at(0).size.height;
-    stride_ = camera_config_->at(0).stride;
+    // The pipeline handler may insist on more buffers than asked for.
+    buffer_count_ = stream_config.bufferCount;
+    width_ = stream_config.size.width;
+    height_ = stream_config.size.height;
+    stride_ = stream_config.stride;
 
+    // Padded rows travel with every frame, consumers honour the stride instead of repacking.
     INFO_PRINT("  width: %d, height: %d, stride: %d", width_, height_, stride_);
 
-    if (width_ != stride_) {
-        ERROR_PRINT("Stride is not equal to width");
-        exit(1);
+    if (has_record_stream()) {
+        auto &record_config = camera_config_->at(0);
+        record_width_ = record_config.size.width;
+        record_height_ = record_config.size.height;
+        record_stride_ = record_config.stride;
+        INFO_PRINT("  record width: %d, height: %d, stride: %d", record_width_, record_height_,
+                   record_stride_);
     }
 
     return *this;
@@ -133,63 +191,110 @@ LibcameraCapturer &LibcameraCapturer::SetRotation(int angle) {
 void LibcameraCapturer::AllocateBuffer() {
     allocator_ = std::make_unique<libcamera::FrameBufferAllocator>(camera_);
 
-    stream_ = camera_config_->at(0).stream();
-    int ret = allocator_->allocate(stream_);
-    if (ret < 0) {
-        ERROR_PRINT("Can't allocate buffers");
-    }
+    stream_ = camera_config_->at(StreamIndex()).stream();
+    record_stream_ = has_record_stream() ? camera_config_->at(0).stream() : nullptr;
 
-    auto &buffers = allocator_->buffers(stream_);
-    if (buffer_count_ != buffers.size()) {
-        ERROR_PRINT("Buffer counts not match allocated buffer number");
-        exit(1);
+    // Each stream gets the count the pipeline validated for it, requests pair them up.
+    int request_count = buffer_count_;
+    for (auto *stream : {stream_, record_stream_}) {
+        if (!stream) {
+            continue;
+        }
+        int ret = allocator_->allocate(stream);
+        if (ret < 0) {
+            ERROR_PRINT("Can't allocate buffers");
+            exit(1);
+        }
+        request_count = std::min(request_count, (int)allocator_->buffers(stream).size());
+    }
+    if (request_count != buffer_count_) {
+        INFO_PRINT("Allocated buffers for %d requests instead of %d", request_count,
+                   buffer_count_);
+        buffer_count_ = request_count;
     }
 
     for (unsigned int i = 0; i < buffer_count_; i++) {
-        auto &buffer = buffers[i];
-        int fd = 0;
-        int buffer_length = 0;
-        for (auto &plane : buffer->planes()) {
-            fd = plane.fd.get();
-            buffer_length += plane.length;
-        }
-        void *memory = mmap(NULL, buffer_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-        mapped_buffers_[fd] = std::make_pair(memory, buffer_length);
-        DEBUG_PRINT("Allocated fd(%d) Buffer[%d] pointer: %p, length: %d", fd, i, memory,
-                    buffer_length);
-
-        auto request = camera_->createRequest();
+        // The cookie is the index of the lease that re-queues the request.
+        auto request = camera_->createRequest(i);
         if (!request) {
             ERROR_PRINT("Can't create camera request");
         }
-        int ret = request->addBuffer(stream_, buffer.get());
-        if (ret < 0) {
-            ERROR_PRINT("Can't set buffer for request");
+
+        // Both streams are filled by the same request, so their frames stay in step.
+        for (auto *stream : {stream_, record_stream_}) {
+            if (!stream) {
+                continue;
+            }
+            auto &buffer = allocator_->buffers(stream)[i];
+            MapBuffer(buffer.get());
+            int ret = request->addBuffer(stream, buffer.get());
+            if (ret < 0) {
+                ERROR_PRINT("Can't set buffer for request");
+            }
         }
         requests_.push_back(std::move(request));
     }
 }
 
+void LibcameraCapturer::MapBuffer(libcamera::FrameBuffer *buffer) {
+    int fd = 0;
+    int buffer_length = 0;
+    for (auto &plane : buffer->planes()) {
+        fd = plane.fd.get();
+        buffer_length += plane.length;
+    }
+    void *memory = mmap(NULL, buffer_length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    mapped_buffers_[fd] = std::make_pair(memory, buffer_length);
+    DEBUG_PRINT("Allocated fd(%d) Buffer pointer: %p, length: %d", fd, memory, buffer_length);
+}
+
 void LibcameraCapturer::RequestComplete(libcamera::Request *request) {
     if (request->status() == libcamera::Request::RequestCancelled) {
+        if (is_stopping_.load()) {
+            return;
+        }
         DEBUG_PRINT("Request has been cancelled");
         exit(1);
     }
 
-    auto &buffers = request->buffers();
-    auto *buffer = buffers.begin()->second;
+    // Runs on libcamera's thread, consumers are served from the pipeline thread instead.
+    completed_requests_.push(request);
+}
 
-    auto &plane = buffer->planes()[0];
-    int fd = plane.fd.get();
-    void *data = mapped_buffers_[fd].first;
-    int length = mapped_buffers_[fd].second;
-    timeval tv = {};
-    tv.tv_sec = buffer->metadata().timestamp / 1000000000;
-    tv.tv_usec = (buffer->metadata().timestamp % 1000000000) / 1000;
+void LibcameraCapturer::ProcessRequest() {
+    auto item = completed_requests_.wait_pop(std::chrono::milliseconds(100));
+    if (!item) {
+        return;
+    }
 
-    V4L2Buffer v4l2_buffer((uint8_t *)data, length, V4L2_BUF_FLAG_KEYFRAME, tv);
-    NextBuffer(v4l2_buffer);
+    auto *request = item.value();
+    auto *buffer = request->findBuffer(stream_);
+    CountSensorDrops(buffer->metadata().sequence);
+
+    if (lease_pool_->is_exhausted()) {
+        dropped_frames_++;
+        DEBUG_PRINT("All capture requests are in use, dropped %u frames.", dropped_frames_);
+        QueueRequest(request);
+        return;
+    }
+
+    auto lease = lease_pool_->Acquire(request->cookie());
+    V4L2Buffer v4l2_buffer = ToV4L2Buffer(buffer, stride_);
+    NextBuffer(v4l2_buffer, lease);
+
+    if (record_stream_) {
+        V4L2Buffer record_buffer =
+            ToV4L2Buffer(request->findBuffer(record_stream_), record_stride_);
+        if (has_record_frame_subscribers()) {
+            NextRecordFrameBuffer(V4L2FrameBuffer::Create(record_width_, record_height_,
+                                                          record_buffer, format_, lease,
+                                                          frame_buffer_pool_));
+        }
+        NextRecordBuffer(record_buffer);
+    }
+}
 
+void LibcameraCapturer::QueueRequest(libcamera::Request *request) {
     request->reuse(libcamera::Request::ReuseBuffers);
 
     {
@@ -200,13 +305,35 @@ void LibcameraCapturer::RequestComplete(libcamera::Request *request) {
     camera_->queueRequest(request);
 }
 
-rtc::scoped_refptr<webrtc::I420BufferInterface> LibcameraCapturer::GetI420Frame() {
-    return frame_buffer_->ToI420();
+void LibcameraCapturer::CountSensorDrops(uint32_t sequence) {
+    if (last_sequence_ >= 0 && sequence > last_sequence_ + 1) {
+        sensor_dropped_frames_ += sequence - last_sequence_ - 1;
+        DEBUG_PRINT("The sensor dropped %llu frames in total.",
+                    (unsigned long long)sensor_dropped_frames_);
+    }
+    last_sequence_ = sequence;
+}
+
+V4L2Buffer LibcameraCapturer::ToV4L2Buffer(libcamera::FrameBuffer *buffer, int stride) {
+    auto &planes = buffer->planes();
+    int fd = planes[0].fd.get();
+    void *data = mapped_buffers_[fd].first;
+    int length = mapped_buffers_[fd].second;
+    timeval tv = {};
+    tv.tv_sec = buffer->metadata().timestamp / 1000000000;
+    tv.tv_usec = (buffer->metadata().timestamp % 1000000000) / 1000;
+
+    V4L2Buffer v4l2_buffer((uint8_t *)data, length, V4L2_BUF_FLAG_KEYFRAME, tv);
+    v4l2_buffer.stride = stride;
+    for (size_t i = 0; i < planes.size() && i < 3; i++) {
+        v4l2_buffer.plane_offsets[i] = planes[i].offset;
+    }
+    return v4l2_buffer;
 }
 
-void LibcameraCapturer::NextBuffer(V4L2Buffer &buffer) {
-    frame_buffer_ = V4L2FrameBuffer::Create(width_, height_, buffer, format_);
-    NextFrameBuffer(frame_buffer_);
+void LibcameraCapturer::NextBuffer(V4L2Buffer &buffer, std::shared_ptr<BufferLease> lease) {
+    NextFrameBuffer(
+        V4L2FrameBuffer::Create(width_, height_, buffer, format_, lease, frame_buffer_pool_));
     NextRawBuffer(buffer);
 }
 
@@ -219,6 +346,15 @@ void LibcameraCapturer::StartCapture() {
 
     AllocateBuffer();
 
+    lease_pool_ = BufferLeasePool::Create(buffer_count_, [this](int index) {
+        QueueRequest(requests_[index].get());
+    });
+
+    worker_ = std::make_unique<Worker>("LibcameraPipeline", [this]() {
+        ProcessRequest();
+    });
+    worker_->Run();
+
     ret = camera_->start(&controls_);
     if (ret) {
         ERROR_PRINT("Failed to start capturing");
@@ -8,6 +8,8 @@
 
 #include "args.h"
 #include "capturer/video_capturer.h"
+#include "common/bounded_queue.h"
+#include "common/buffer_lease.h"
 #include "common/interface/subject.h"
 #include "common/v4l2_frame_buffer.h"
 #include "common/v4l2_utils.h"
@@ -25,9 +27,12 @@ class LibcameraCapturer : public VideoCapturer {
     bool is_dma_capture() const override;
     uint32_t format() const override;
     Args config() const override;
+    bool has_record_stream() const override;
+    int record_width() const override;
+    int record_height() const override;
+    bool has_frame_lease() const override;
 
     LibcameraCapturer &SetControls(const int key, const int value) override;
-    rtc::scoped_refptr<webrtc::I420BufferInterface> GetI420Frame() override;
     void StartCapture() override;
 
   private:
@@ -35,7 +40,14 @@ class LibcameraCapturer : public VideoCapturer {
     int width_;
     int height_;
     int stride_;
+    int record_width_;
+    int record_height_;
+    int record_stride_;
     int buffer_count_;
+    unsigned int dropped_frames_;
+    uint64_t sensor_dropped_frames_;
+    int64_t last_sequence_;
+    std::atomic<bool> is_stopping_;
     uint32_t format_;
     Args config_;
     std::mutex control_mutex_;
@@ -46,11 +58,19 @@ class LibcameraCapturer : public VideoCapturer {
     std::unique_ptr<libcamera::FrameBufferAllocator> allocator_;
     std::vector<std::unique_ptr<libcamera::Request>> requests_;
     libcamera::Stream *stream_;
+    // The full resolution stream for the recorder, null when recording the WebRTC stream.
+    libcamera::Stream *record_stream_;
     libcamera::ControlList controls_;
     std::map<int, std::pair<void *, unsigned int>> mapped_buffers_;
+    // Completed requests wait here for the pipeline thread, libcamera's thread never blocks.
+    BoundedQueue<libcamera::Request *> completed_requests_;
+    std::shared_ptr<BufferLeasePool> lease_pool_;
+    std::unique_ptr<Worker> worker_;
 
-    rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer_;
-    void NextBuffer(V4L2Buffer &raw_buffer);
+    void NextBuffer(V4L2Buffer &raw_buffer, std::shared_ptr<BufferLease> lease);
+    V4L2Buffer ToV4L2Buffer(libcamera::FrameBuffer *buffer, int stride);
+    void MapBuffer(libcamera::FrameBuffer *buffer);
+    int StreamIndex() const;
 
     LibcameraCapturer &SetFormat(int width, int height);
     LibcameraCapturer &SetFps(int fps);
@@ -59,6 +79,9 @@ class LibcameraCapturer : public VideoCapturer {
     void Init(int deviceId);
     void AllocateBuffer();
     void RequestComplete(libcamera::Request *request);
+    void ProcessRequest();
+    void QueueRequest(libcamera::Request *request);
+    void CountSensorDrops(uint32_t sequence);
 };
 
 #endif
@@ -3,7 +3,7 @@
 // Linux
 #include <linux/videodev2.h>
 #include <sys/mman.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
 
 // WebRTC
 #include <modules/video_capture/video_capture_factory.h>
@@ -11,6 +11,11 @@
 
 #include "common/logging.h"
 
+// A snapshot waits up to a second, a key frame requested earlier is still on its way.
+static const std::chrono::milliseconds kKeyFrameRequestInterval(1000);
+// Software decoding lags behind by at most this many access units before it resyncs.
+static const int kH264QueueDepth = 4;
+
 std::shared_ptr<V4L2Capturer> V4L2Capturer::Create(Args args) {
     auto ptr = std::make_shared<V4L2Capturer>(args);
     ptr->Init(args.cameraId);
@@ -22,11 +27,14 @@ std::shared_ptr<V4L2Capturer> V4L2Capturer::Create(Args args) {
 }
 
 V4L2Capturer::V4L2Capturer(Args args)
-    : buffer_count_(4),
+    : buffer_count_(args.buffer_count),
+      dropped_frames_(0),
       hw_accel_(args.hw_accel),
       format_(args.format),
       has_first_keyframe_(false),
-      config_(args) {}
+      is_h264_synced_(false),
+      config_(args),
+      h264_frames_(kH264QueueDepth) {}
 
 void V4L2Capturer::Init(int deviceId) {
     std::string devicePath = "/dev/video" + std::to_string(deviceId);
@@ -38,11 +46,26 @@ void V4L2Capturer::Init(int deviceId) {
 }
 
 V4L2Capturer::~V4L2Capturer() {
-    worker_.reset();
+    if (reactor_) {
+        reactor_->RemoveFd(fd_);
+    }
     decoder_.reset();
+    mjpeg_decode_pool_.reset();
+    h264_frames_.shutdown();
+    h264_worker_.reset();
+    h264_decoder_.reset();
     V4L2Util::StreamOff(fd_, capture_.type);
-    V4L2Util::DeallocateBuffer(fd_, &capture_);
-    V4L2Util::CloseDevice(fd_);
+
+    // Frames still holding a lease point into the mapped buffers, the last one unmaps them.
+    auto release_buffers = [fd = fd_, capture = capture_]() mutable {
+        V4L2Util::DeallocateBuffer(fd, &capture);
+        V4L2Util::CloseDevice(fd);
+    };
+    if (lease_pool_) {
+        lease_pool_->Close(std::move(release_buffers));
+    } else {
+        release_buffers();
+    }
 }
 
 int V4L2Capturer::fps() const { return fps_; }
@@ -61,6 +84,10 @@ bool V4L2Capturer::IsCompressedFormat() const {
     return format_ == V4L2_PIX_FMT_MJPEG || format_ == V4L2_PIX_FMT_H264;
 }
 
+bool V4L2Capturer::IsH264Passthrough() const {
+    return hw_accel_ && format_ == V4L2_PIX_FMT_H264;
+}
+
 bool V4L2Capturer::CheckMatchingDevice(std::string unique_name) {
     struct v4l2_capability cap;
     if (V4L2Util::QueryCapabilities(fd_, &cap) && cap.bus_info[0] != 0 &&
@@ -89,12 +116,21 @@ V4L2Capturer &V4L2Capturer::SetFormat(int width, int height) {
     width_ = width;
     height_ = height;
 
-    V4L2Util::SetFormat(fd_, &capture_, width, height, format_);
+    if (!V4L2Util::SetFormat(fd_, &capture_, width, height, format_)) {
+        std::string device_path = "/dev/video" + std::to_string(config_.cameraId);
+        std::string formats;
+        for (auto &format : V4L2Util::GetDeviceSupportedFormats(device_path.c_str())) {
+            formats += " " + format;
+        }
+        ERROR_PRINT("%s supports:%s", device_path.c_str(), formats.c_str());
+        exit(-1);
+    }
     V4L2Util::SetExtCtrl(fd_, V4L2_CID_MPEG_VIDEO_BITRATE, 10000 * 1000);
 
     if (format_ == V4L2_PIX_FMT_H264) {
         V4L2Util::SetExtCtrl(fd_, V4L2_CID_MPEG_VIDEO_BITRATE_MODE,
                              V4L2_MPEG_VIDEO_BITRATE_MODE_VBR);
+        // WebRTC is offered this profile too when the stream is passed through.
         V4L2Util::SetExtCtrl(fd_, V4L2_CID_MPEG_VIDEO_H264_PROFILE,
                              V4L2_MPEG_VIDEO_H264_PROFILE_HIGH);
         V4L2Util::SetExtCtrl(fd_, V4L2_CID_MPEG_VIDEO_REPEAT_SEQ_HEADER, true);
@@ -122,21 +158,6 @@ V4L2Capturer &V4L2Capturer::SetRotation(int angle) {
 }
 
 void V4L2Capturer::CaptureImage() {
-    fd_set fds;
-    FD_ZERO(&fds);
-    FD_SET(fd_, &fds);
-    timeval tv = {};
-    tv.tv_sec = 0;
-    tv.tv_usec = 200000;
-    int r = select(fd_ + 1, &fds, NULL, NULL, &tv);
-    if (r == -1) {
-        ERROR_PRINT("select failed");
-        return;
-    } else if (r == 0) { // timeout
-        DEBUG_PRINT("capture timeout");
-        return;
-    }
-
     v4l2_buffer buf = {};
     buf.type = capture_.type;
     buf.memory = capture_.memory;
@@ -145,65 +166,170 @@ void V4L2Capturer::CaptureImage() {
         return;
     }
 
+    if (lease_pool_->is_exhausted()) {
+        dropped_frames_++;
+        DEBUG_PRINT("All capture buffers are in use, dropped %u frames.", dropped_frames_);
+        V4L2Util::QueueBuffer(fd_, &buf);
+        return;
+    }
+
     V4L2Buffer buffer((uint8_t *)capture_.buffers[buf.index].start, buf.bytesused, buf.flags,
                       buf.timestamp);
-    NextBuffer(buffer);
+    // The driver's sequence lets H264 consumers notice a frame they never saw.
+    buffer.inner = buf;
+    NextBuffer(buffer, lease_pool_->Acquire(buf.index));
+}
 
-    if (!V4L2Util::QueueBuffer(fd_, &buf)) {
-        return;
+bool V4L2Capturer::has_frame_lease() const {
+    // Frames coming out of the hardware decoder live in its capture buffers.
+    return !(hw_accel_ && IsCompressedFormat());
+}
+
+void V4L2Capturer::RequestKeyFrame() {
+    if (format_ == V4L2_PIX_FMT_H264) {
+        V4L2Util::SetExtCtrl(fd_, V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
     }
 }
 
-rtc::scoped_refptr<webrtc::I420BufferInterface> V4L2Capturer::GetI420Frame() {
-    return frame_buffer_->ToI420();
+void V4L2Capturer::RequestSyncKeyFrame() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_keyframe_request_ < kKeyFrameRequestInterval) {
+        return;
+    }
+    last_keyframe_request_ = now;
+    RequestKeyFrame();
 }
 
-void V4L2Capturer::NextBuffer(V4L2Buffer &buffer) {
+void V4L2Capturer::NextBuffer(V4L2Buffer &buffer, std::shared_ptr<BufferLease> lease) {
     if (hw_accel_) {
         // hardware encoding
         if (!has_first_keyframe_) {
             has_first_keyframe_ = (buffer.flags & V4L2_BUF_FLAG_KEYFRAME) != 0;
         }
 
-        if (IsCompressedFormat()) {
+        if (IsH264Passthrough()) {
+            // Only key frames are decoded to keep a picture around for snapshots, the stream
+            // itself goes to WebRTC untouched.
+            if (buffer.flags & V4L2_BUF_FLAG_KEYFRAME) {
+                decoder_->EmplaceBuffer(buffer, [this](V4L2Buffer decoded_buffer) {
+                    PublishLatestFrame(V4L2FrameBuffer::Create(width_, height_, decoded_buffer,
+                                                               V4L2_PIX_FMT_YUV420, nullptr,
+                                                               frame_buffer_pool_));
+                });
+            } else if (has_snapshot_demand()) {
+                // A snapshot would wait for the next key frame otherwise.
+                RequestSyncKeyFrame();
+            }
+            NextFrameBuffer(V4L2FrameBuffer::Create(width_, height_, buffer, format_, lease,
+                                                    frame_buffer_pool_));
+        } else if (IsCompressedFormat()) {
             decoder_->EmplaceBuffer(buffer, [this](V4L2Buffer decoded_buffer) {
-                frame_buffer_ =
-                    V4L2FrameBuffer::Create(width_, height_, decoded_buffer, V4L2_PIX_FMT_YUV420);
-                NextFrameBuffer(frame_buffer_);
+                NextFrameBuffer(V4L2FrameBuffer::Create(width_, height_, decoded_buffer,
+                                                        V4L2_PIX_FMT_YUV420, nullptr,
+                                                        frame_buffer_pool_));
             });
         } else {
-            frame_buffer_ = V4L2FrameBuffer::Create(width_, height_, buffer, format_);
-            NextFrameBuffer(frame_buffer_);
+            NextFrameBuffer(V4L2FrameBuffer::Create(width_, height_, buffer, format_, lease,
+                                                    frame_buffer_pool_));
         }
     } else {
         // software decoding
-        if (format_ != V4L2_PIX_FMT_H264) {
-            frame_buffer_ = V4L2FrameBuffer::Create(width_, height_, buffer, format_);
-            NextFrameBuffer(frame_buffer_);
+        if (mjpeg_decode_pool_) {
+            // Decoded only for viewers and snapshots, the recorder takes the raw buffers.
+            if (has_frame_subscribers() || has_snapshot_demand()) {
+                mjpeg_decode_pool_->Decode(V4L2FrameBuffer::Create(width_, height_, buffer, format_,
+                                                                   lease, frame_buffer_pool_));
+            }
+        } else if (format_ != V4L2_PIX_FMT_H264) {
+            NextFrameBuffer(V4L2FrameBuffer::Create(width_, height_, buffer, format_, lease,
+                                                    frame_buffer_pool_));
         } else {
-            // todo: h264 decoding
-            INFO_PRINT("Software decoding h264 camera source is not support now.");
-            exit(1);
+            DecodeH264(buffer);
         }
     }
 
     NextRawBuffer(buffer);
 }
 
+void V4L2Capturer::DecodeH264(V4L2Buffer &buffer) {
+    bool has_subscribers = has_frame_subscribers();
+    if (!has_subscribers && !has_snapshot_demand()) {
+        // Nobody needs pixels, the stream still reaches the raw buffer subscribers.
+        is_h264_synced_ = false;
+        return;
+    }
+
+    bool is_keyframe = (buffer.flags & V4L2_BUF_FLAG_KEYFRAME) != 0;
+    if (is_keyframe) {
+        is_h264_synced_ = true;
+    } else if (!is_h264_synced_ || !has_subscribers) {
+        // P frames are useless until a key frame is decoded, and a snapshot needs a key frame only.
+        is_h264_synced_ = false;
+        RequestSyncKeyFrame();
+        return;
+    }
+
+    // The reactor thread only copies the access unit, the driver buffer goes straight back.
+    auto frame_buffer =
+        V4L2FrameBuffer::Create(width_, height_, buffer, format_, nullptr, frame_buffer_pool_)
+            ->Copy();
+    if (!h264_frames_.push(frame_buffer)) {
+        // Every following P frame refers to the one dropped here.
+        is_h264_synced_ = false;
+        RequestSyncKeyFrame();
+    }
+}
+
+void V4L2Capturer::DecodeNextH264() {
+    auto frame_buffer = h264_frames_.wait_pop(std::chrono::milliseconds(100));
+    if (!frame_buffer) {
+        return;
+    }
+
+    V4L2Buffer buffer = (*frame_buffer)->GetRawBuffer();
+    auto decoded_buffer = h264_decoder_->Decode(buffer);
+    if (!decoded_buffer) {
+        return;
+    }
+
+    if (has_frame_subscribers()) {
+        NextFrameBuffer(decoded_buffer);
+    } else {
+        PublishLatestFrame(decoded_buffer);
+    }
+}
+
 void V4L2Capturer::StartCapture() {
     if (!V4L2Util::AllocateBuffer(fd_, &capture_, buffer_count_) ||
         !V4L2Util::QueueBuffers(fd_, &capture_)) {
         exit(0);
     }
 
+    lease_pool_ = BufferLeasePool::Create(buffer_count_, [this](int index) {
+        V4L2Util::QueueBuffer(fd_, &capture_.buffers[index].inner);
+    });
+
     V4L2Util::StreamOn(fd_, capture_.type);
 
     if (hw_accel_ && IsCompressedFormat()) {
         decoder_ = V4L2Decoder::Create(config_.width, config_.height, format_, true);
+    } else if (format_ == V4L2_PIX_FMT_MJPEG && config_.mjpeg_decode_threads > 0) {
+        // Frames go out already decoded, instead of each consumer decoding them on its own.
+        mjpeg_decode_pool_ = MjpegDecodePool::Create(
+            width_, height_, config_.mjpeg_decode_threads, config_.mjpeg_decode_depth,
+            frame_buffer_pool_, [this](rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+                NextFrameBuffer(frame_buffer);
+            });
+    } else if (format_ == V4L2_PIX_FMT_H264) {
+        h264_decoder_ = FFmpegH264Decoder::Create(width_, height_, frame_buffer_pool_);
+        h264_worker_ = std::make_unique<Worker>("H264Decode", [this]() {
+            DecodeNextH264();
+        });
+        h264_worker_->Run();
     }
 
-    worker_ = std::make_unique<Worker>("V4L2Capture", [this]() {
+    reactor_ = Reactor::Acquire();
+    reactor_->AddFd(fd_, EPOLLIN, "V4L2Capture", [this](uint32_t events) {
         CaptureImage();
     });
-    worker_->Run();
 }
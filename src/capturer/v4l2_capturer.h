@@ -1,14 +1,20 @@
 #ifndef V4L2_CAPTURER_H_
 #define V4L2_CAPTURER_H_
 
+#include <chrono>
+
 #include <modules/video_capture/video_capture.h>
 
 #include "args.h"
 #include "capturer/video_capturer.h"
+#include "codecs/h264/ffmpeg_h264_decoder.h"
+#include "codecs/jpeg/mjpeg_decode_pool.h"
 #include "codecs/v4l2/v4l2_decoder.h"
+#include "common/bounded_queue.h"
 #include "common/interface/subject.h"
 #include "common/v4l2_frame_buffer.h"
 #include "common/v4l2_utils.h"
+#include "common/reactor.h"
 #include "common/worker.h"
 
 class V4L2Capturer : public VideoCapturer {
@@ -24,7 +30,8 @@ class V4L2Capturer : public VideoCapturer {
     uint32_t format() const override;
     Args config() const override;
     void StartCapture() override;
-    rtc::scoped_refptr<webrtc::I420BufferInterface> GetI420Frame() override;
+    void RequestKeyFrame() override;
+    bool has_frame_lease() const override;
 
   private:
     int fd_;
@@ -32,16 +39,28 @@ class V4L2Capturer : public VideoCapturer {
     int width_;
     int height_;
     int buffer_count_;
+    unsigned int dropped_frames_;
     bool hw_accel_;
     bool has_first_keyframe_;
+    bool is_h264_synced_;
     uint32_t format_;
     Args config_;
     V4L2BufferGroup capture_;
-    std::unique_ptr<Worker> worker_;
+    std::shared_ptr<BufferLeasePool> lease_pool_;
+    std::shared_ptr<Reactor> reactor_;
     std::unique_ptr<V4L2Decoder> decoder_;
+    std::unique_ptr<MjpegDecodePool> mjpeg_decode_pool_;
+    std::unique_ptr<FFmpegH264Decoder> h264_decoder_;
+    // Access units copied off the reactor thread, decoded in order by `h264_worker_`.
+    BoundedQueue<rtc::scoped_refptr<V4L2FrameBuffer>> h264_frames_;
+    std::unique_ptr<Worker> h264_worker_;
+    std::chrono::steady_clock::time_point last_keyframe_request_;
 
-    rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer_;
-    void NextBuffer(V4L2Buffer &raw_buffer);
+    void NextBuffer(V4L2Buffer &raw_buffer, std::shared_ptr<BufferLease> lease);
+    void DecodeH264(V4L2Buffer &buffer);
+    void DecodeNextH264();
+    // Asks the camera for a key frame to start decoding from, at most once per interval.
+    void RequestSyncKeyFrame();
 
     V4L2Capturer &SetFormat(int width, int height);
     V4L2Capturer &SetFps(int fps = 30);
@@ -49,6 +68,7 @@ class V4L2Capturer : public VideoCapturer {
 
     void Init(int deviceId);
     bool IsCompressedFormat() const;
+    bool IsH264Passthrough() const;
     void CaptureImage();
     bool CheckMatchingDevice(std::string unique_name);
     int GetCameraIndex(webrtc::VideoCaptureModule::DeviceInfo *device_info);
@@ -2,7 +2,9 @@
 #define VIDEO_CAPTURER_H_
 
 #include "args.h"
+#include "common/frame_buffer_pool.h"
 #include "common/interface/subject.h"
+#include "common/latest_frame_store.h"
 #include "common/v4l2_frame_buffer.h"
 #include "common/v4l2_utils.h"
 #include <modules/video_capture/video_capture.h>
@@ -13,6 +15,8 @@ class VideoCapturer {
     ~VideoCapturer() {
         raw_buffer_subject_.UnSubscribe();
         frame_buffer_subject_.UnSubscribe();
+        record_buffer_subject_.UnSubscribe();
+        record_frame_buffer_subject_.UnSubscribe();
     }
 
     virtual int fps() const = 0;
@@ -22,9 +26,23 @@ class VideoCapturer {
     virtual uint32_t format() const = 0;
     virtual Args config() const = 0;
     virtual void StartCapture() = 0;
-    virtual rtc::scoped_refptr<webrtc::I420BufferInterface> GetI420Frame() = 0;
+    // `sequence`, when given, identifies the returned frame, e.g. to reuse work done on it.
+    virtual rtc::scoped_refptr<webrtc::I420BufferInterface>
+    GetI420Frame(uint64_t *sequence = nullptr) {
+        return latest_frame_store_.GetI420Frame(std::chrono::milliseconds(1000), sequence);
+    }
 
     virtual VideoCapturer &SetControls(const int key, const int value) { return *this; };
+    virtual void RequestKeyFrame(){};
+    // Whether emitted frames own their memory until released, i.e. may be consumed later on
+    // another thread instead of within the frame callback.
+    virtual bool has_frame_lease() const { return false; }
+    // Whether recordings come from a stream of their own rather than the WebRTC one.
+    virtual bool has_record_stream() const { return false; }
+    virtual int record_width() const { return width(); }
+    virtual int record_height() const { return height(); }
+
+    std::shared_ptr<FrameBufferPool> frame_buffer_pool() const { return frame_buffer_pool_; }
 
     std::shared_ptr<Observable<V4L2Buffer>> AsRawBufferObservable() {
         return raw_buffer_subject_.AsObservable();
@@ -34,16 +52,53 @@ class VideoCapturer {
         return frame_buffer_subject_.AsObservable();
     }
 
+    // Falls back to the WebRTC stream when there is no recording stream.
+    std::shared_ptr<Observable<V4L2Buffer>> AsRecordBufferObservable() {
+        return has_record_stream() ? record_buffer_subject_.AsObservable()
+                                   : raw_buffer_subject_.AsObservable();
+    }
+
+    std::shared_ptr<Observable<rtc::scoped_refptr<V4L2FrameBuffer>>>
+    AsRecordFrameBufferObservable() {
+        return has_record_stream() ? record_frame_buffer_subject_.AsObservable()
+                                   : frame_buffer_subject_.AsObservable();
+    }
+
   protected:
+    // Backs the copies frames make of their driver buffer.
+    std::shared_ptr<FrameBufferPool> frame_buffer_pool_ = FrameBufferPool::Create();
+
     void NextRawBuffer(V4L2Buffer raw_buffer) { raw_buffer_subject_.Next(raw_buffer); }
 
     void NextFrameBuffer(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+        if (frame_buffer->format() != V4L2_PIX_FMT_H264) {
+            PublishLatestFrame(frame_buffer);
+        }
         frame_buffer_subject_.Next(frame_buffer);
     }
 
+    void NextRecordBuffer(V4L2Buffer raw_buffer) { record_buffer_subject_.Next(raw_buffer); }
+
+    void NextRecordFrameBuffer(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+        record_frame_buffer_subject_.Next(frame_buffer);
+    }
+
+    // For frames that are only kept around for snapshots, e.g. decoded key frames.
+    void PublishLatestFrame(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+        latest_frame_store_.Publish(frame_buffer);
+    }
+
+    // Lets sources that have to decode first skip frames nobody is going to look at.
+    bool has_frame_subscribers() { return frame_buffer_subject_.HasSubscribers(); }
+    bool has_record_frame_subscribers() { return record_frame_buffer_subject_.HasSubscribers(); }
+    bool has_snapshot_demand() const { return latest_frame_store_.has_demand(); }
+
   private:
+    LatestFrameStore latest_frame_store_;
     Subject<V4L2Buffer> raw_buffer_subject_;
     Subject<rtc::scoped_refptr<V4L2FrameBuffer>> frame_buffer_subject_;
+    Subject<V4L2Buffer> record_buffer_subject_;
+    Subject<rtc::scoped_refptr<V4L2FrameBuffer>> record_frame_buffer_subject_;
 };
 
 #endif
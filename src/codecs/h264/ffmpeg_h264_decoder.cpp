@@ -0,0 +1,108 @@
+#include "codecs/h264/ffmpeg_h264_decoder.h"
+#include "common/logging.h"
+
+#include <string.h>
+
+#include <third_party/libyuv/include/libyuv.h>
+
+std::unique_ptr<FFmpegH264Decoder>
+FFmpegH264Decoder::Create(int width, int height, std::shared_ptr<FrameBufferPool> pool) {
+    auto decoder = std::make_unique<FFmpegH264Decoder>(width, height, std::move(pool));
+    if (!decoder->Init()) {
+        exit(1);
+    }
+    return decoder;
+}
+
+FFmpegH264Decoder::FFmpegH264Decoder(int width, int height,
+                                     std::shared_ptr<FrameBufferPool> pool)
+    : width_(width),
+      height_(height),
+      pool_(pool ? std::move(pool) : FrameBufferPool::Create()),
+      codec_ctx_(nullptr),
+      packet_(nullptr),
+      frame_(nullptr),
+      is_mismatch_logged_(false) {}
+
+FFmpegH264Decoder::~FFmpegH264Decoder() {
+    av_frame_free(&frame_);
+    av_packet_free(&packet_);
+    avcodec_free_context(&codec_ctx_);
+}
+
+bool FFmpegH264Decoder::Init() {
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    if (!codec) {
+        ERROR_PRINT("H264 software decoder is not available");
+        return false;
+    }
+
+    codec_ctx_ = avcodec_alloc_context3(codec);
+    codec_ctx_->width = width_;
+    codec_ctx_->height = height_;
+    // Every access unit has to come straight back out, frame threading would hold some back.
+    codec_ctx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    codec_ctx_->thread_type = FF_THREAD_SLICE;
+
+    if (avcodec_open2(codec_ctx_, codec, nullptr) < 0) {
+        ERROR_PRINT("Could not open the H264 software decoder");
+        return false;
+    }
+
+    packet_ = av_packet_alloc();
+    frame_ = av_frame_alloc();
+    DEBUG_PRINT("H264 software decoder is ready: %dx%d", width_, height_);
+    return true;
+}
+
+rtc::scoped_refptr<V4L2FrameBuffer> FFmpegH264Decoder::Decode(V4L2Buffer &buffer) {
+    padded_input_.resize(buffer.length + AV_INPUT_BUFFER_PADDING_SIZE);
+    memcpy(padded_input_.data(), buffer.start, buffer.length);
+    memset(padded_input_.data() + buffer.length, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    packet_->data = padded_input_.data();
+    packet_->size = buffer.length;
+    int ret = avcodec_send_packet(codec_ctx_, packet_);
+    av_packet_unref(packet_);
+    if (ret < 0) {
+        DEBUG_PRINT("Failed to send the packet to the H264 decoder: %d", ret);
+        return nullptr;
+    }
+
+    if (avcodec_receive_frame(codec_ctx_, frame_) < 0) {
+        return nullptr;
+    }
+
+    // Full range streams, common on UVC webcams, come out as YUVJ420P, the planes are the same.
+    if (frame_->width != width_ || frame_->height != height_ ||
+        (frame_->format != AV_PIX_FMT_YUV420P && frame_->format != AV_PIX_FMT_YUVJ420P)) {
+        if (!is_mismatch_logged_) {
+            is_mismatch_logged_ = true;
+            ERROR_PRINT("Unexpected H264 picture: %dx%d, format %d", frame_->width,
+                        frame_->height, frame_->format);
+        }
+        av_frame_unref(frame_);
+        return nullptr;
+    }
+    is_mismatch_logged_ = false;
+
+    const int stride_y = width_;
+    const int stride_uv = (width_ + 1) / 2;
+    const int chroma_height = (height_ + 1) / 2;
+    const unsigned int size = stride_y * height_ + 2 * stride_uv * chroma_height;
+
+    PooledBlock data = pool_->Acquire(size);
+    uint8_t *data_y = data.get();
+    uint8_t *data_u = data_y + stride_y * height_;
+    uint8_t *data_v = data_u + stride_uv * chroma_height;
+    libyuv::I420Copy(frame_->data[0], frame_->linesize[0], frame_->data[1], frame_->linesize[1],
+                     frame_->data[2], frame_->linesize[2], data_y, stride_y, data_u, stride_uv,
+                     data_v, stride_uv, width_, height_);
+    av_frame_unref(frame_);
+
+    V4L2Buffer decoded_buffer = buffer;
+    decoded_buffer.start = nullptr;
+    decoded_buffer.length = size;
+    return V4L2FrameBuffer::Create(width_, height_, std::move(data), decoded_buffer,
+                                   V4L2_PIX_FMT_YUV420);
+}
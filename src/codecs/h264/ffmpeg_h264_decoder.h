@@ -0,0 +1,41 @@
+#ifndef FFMPEG_H264_DECODER_H_
+#define FFMPEG_H264_DECODER_H_
+
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+#include "common/frame_buffer_pool.h"
+#include "common/v4l2_frame_buffer.h"
+
+/* Software H264 decoding for boards without a usable m2m decoder. Pictures come out as packed
+ * I420 frames backed by the given pool, one call per access unit and without frame delay. */
+class FFmpegH264Decoder {
+  public:
+    static std::unique_ptr<FFmpegH264Decoder> Create(int width, int height,
+                                                     std::shared_ptr<FrameBufferPool> pool);
+
+    FFmpegH264Decoder(int width, int height, std::shared_ptr<FrameBufferPool> pool);
+    ~FFmpegH264Decoder();
+
+    // Returns null while the decoder has no picture to show, e.g. after a corrupt frame.
+    rtc::scoped_refptr<V4L2FrameBuffer> Decode(V4L2Buffer &buffer);
+
+  private:
+    int width_;
+    int height_;
+    std::shared_ptr<FrameBufferPool> pool_;
+    AVCodecContext *codec_ctx_;
+    AVPacket *packet_;
+    AVFrame *frame_;
+    bool is_mismatch_logged_;
+    // The parser may read past the end of the input, see AV_INPUT_BUFFER_PADDING_SIZE.
+    std::vector<uint8_t> padded_input_;
+
+    bool Init();
+};
+
+#endif // FFMPEG_H264_DECODER_H_
@@ -15,8 +15,10 @@ class Openh264Encoder {
     Openh264Encoder(Args args);
     ~Openh264Encoder();
     void Init();
+    // `on_capture` gets the access unit and whether it is an IDR frame.
     void Encode(rtc::scoped_refptr<webrtc::I420BufferInterface> frame_buffer,
-                std::function<void(uint8_t *, int)> on_capture);
+                std::function<void(uint8_t *, int, bool)> on_capture);
+    void ForceKeyFrame();
 
   private:
     int fps_;
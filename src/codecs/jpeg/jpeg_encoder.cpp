@@ -0,0 +1,113 @@
+#include "codecs/jpeg/jpeg_encoder.h"
+#include "common/logging.h"
+
+#include <chrono>
+#include <future>
+#include <string.h>
+
+#include <third_party/libyuv/include/libyuv.h>
+
+static const std::chrono::milliseconds kHardwareTimeout(1000);
+// Each failure costs a timeout and a device reopen, a broken encoder is not retried forever.
+static const int kMaxHardwareFailures = 3;
+
+std::shared_ptr<JpegEncoder> JpegEncoder::Acquire() {
+    static std::mutex instance_mutex;
+    static std::weak_ptr<JpegEncoder> instance;
+
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    auto shared = instance.lock();
+    if (!shared) {
+        shared = Create(V4L2JpegEncoder::kDefaultFile, V4L2_PIX_FMT_JPEG);
+        instance = shared;
+    }
+    return shared;
+}
+
+std::shared_ptr<JpegEncoder> JpegEncoder::Create(const char *file, uint32_t dst_pix_fmt) {
+    auto encoder = std::make_shared<JpegEncoder>(file, dst_pix_fmt);
+    INFO_PRINT("Jpeg images are encoded in %s.", encoder->is_hardware() ? file : "software");
+    return encoder;
+}
+
+JpegEncoder::JpegEncoder(const char *file, uint32_t dst_pix_fmt)
+    : file_(file),
+      dst_pix_fmt_(dst_pix_fmt),
+      is_hardware_(V4L2JpegEncoder::IsAvailable(file, dst_pix_fmt)),
+      hardware_failures_(0),
+      width_(0),
+      height_(0) {}
+
+bool JpegEncoder::is_hardware() const { return is_hardware_.load(); }
+
+Buffer JpegEncoder::Encode(rtc::scoped_refptr<webrtc::I420BufferInterface> i420_buffer,
+                           int quality) {
+    if (is_hardware_.load()) {
+        auto buffer = EncodeHardware(i420_buffer, quality);
+        if (buffer.start) {
+            hardware_failures_.store(0);
+            return buffer;
+        }
+        if (hardware_failures_.fetch_add(1) + 1 >= kMaxHardwareFailures) {
+            is_hardware_.store(false);
+            ERROR_PRINT("Hardware jpeg encoding failed %d times in a row, using software only.",
+                        kMaxHardwareFailures);
+        } else {
+            ERROR_PRINT("Hardware jpeg encoding failed, falling back to software.");
+        }
+    }
+
+    return Utils::ConvertYuvToJpeg(i420_buffer->DataY(), i420_buffer->StrideY(),
+                                   i420_buffer->DataU(), i420_buffer->StrideU(),
+                                   i420_buffer->DataV(), i420_buffer->StrideV(),
+                                   i420_buffer->width(), i420_buffer->height(), quality);
+}
+
+Buffer JpegEncoder::EncodeHardware(rtc::scoped_refptr<webrtc::I420BufferInterface> i420_buffer,
+                                   int quality) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const int width = i420_buffer->width();
+    const int height = i420_buffer->height();
+
+    if (!encoder_ || width != width_ || height != height_) {
+        encoder_.reset();
+        encoder_ = V4L2JpegEncoder::Create(width, height, false, file_, dst_pix_fmt_);
+        if (!encoder_) {
+            return {};
+        }
+        encoder_->SetBackpressure(V4L2Codec::Backpressure::Block);
+        width_ = width;
+        height_ = height;
+    }
+    encoder_->SetQuality(quality);
+
+    // The device takes tightly packed planes.
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    packed_.resize(width * height + 2 * chroma_width * chroma_height);
+    uint8_t *data_y = packed_.data();
+    uint8_t *data_u = data_y + width * height;
+    uint8_t *data_v = data_u + chroma_width * chroma_height;
+    libyuv::I420Copy(i420_buffer->DataY(), i420_buffer->StrideY(), i420_buffer->DataU(),
+                     i420_buffer->StrideU(), i420_buffer->DataV(), i420_buffer->StrideV(), data_y,
+                     width, data_u, chroma_width, data_v, chroma_width, width, height);
+
+    // Shared with the callback, which may still run after a timeout here.
+    auto promise = std::make_shared<std::promise<Buffer>>();
+    auto future = promise->get_future();
+    V4L2Buffer src_buffer(packed_.data(), packed_.size());
+    encoder_->EmplaceBuffer(src_buffer, [promise](V4L2Buffer &encoded_buffer) {
+        Buffer buffer;
+        buffer.start.reset(static_cast<uint8_t *>(malloc(encoded_buffer.length)));
+        memcpy(buffer.start.get(), encoded_buffer.start, encoded_buffer.length);
+        buffer.length = encoded_buffer.length;
+        promise->set_value(std::move(buffer));
+    });
+
+    if (future.wait_for(kHardwareTimeout) != std::future_status::ready) {
+        // Start over with a fresh device next time.
+        encoder_.reset();
+        return {};
+    }
+    return future.get();
+}
@@ -0,0 +1,45 @@
+#ifndef JPEG_ENCODER_H_
+#define JPEG_ENCODER_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <api/video/video_frame_buffer.h>
+
+#include "codecs/v4l2/v4l2_jpeg_encoder.h"
+#include "common/utils.h"
+
+/* Compresses snapshots and thumbnails on the m2m JPEG encoder when the board has one, otherwise,
+ * or if the hardware fails, with libjpeg. The hardware is given up on after a few failures in a
+ * row. Callers share one instance, hardware encodes are serialized and the device stays
+ * configured for the last frame size. */
+class JpegEncoder {
+  public:
+    static std::shared_ptr<JpegEncoder> Acquire();
+    // For tests, e.g. against vicodec with V4L2_PIX_FMT_FWHT.
+    static std::shared_ptr<JpegEncoder> Create(const char *file, uint32_t dst_pix_fmt);
+
+    JpegEncoder(const char *file, uint32_t dst_pix_fmt);
+
+    // Never call it on the reactor thread, it waits for the device.
+    Buffer Encode(rtc::scoped_refptr<webrtc::I420BufferInterface> i420_buffer, int quality);
+    bool is_hardware() const;
+
+  private:
+    const char *file_;
+    uint32_t dst_pix_fmt_;
+    std::atomic<bool> is_hardware_;
+    std::atomic<int> hardware_failures_;
+    std::mutex mutex_;
+    int width_;
+    int height_;
+    std::unique_ptr<V4L2JpegEncoder> encoder_;
+    std::vector<uint8_t> packed_;
+
+    Buffer EncodeHardware(rtc::scoped_refptr<webrtc::I420BufferInterface> i420_buffer,
+                          int quality);
+};
+
+#endif // JPEG_ENCODER_H_
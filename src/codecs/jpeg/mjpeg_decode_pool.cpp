@@ -0,0 +1,137 @@
+#include "codecs/jpeg/mjpeg_decode_pool.h"
+#include "common/logging.h"
+
+#include <algorithm>
+
+#include <third_party/libyuv/include/libyuv.h>
+
+std::unique_ptr<MjpegDecodePool> MjpegDecodePool::Create(int width, int height, int num_threads,
+                                                         int depth,
+                                                         std::shared_ptr<FrameBufferPool> pool,
+                                                         OnDecodedFunc on_decoded) {
+    auto ptr = std::make_unique<MjpegDecodePool>(width, height, depth, std::move(pool),
+                                                 std::move(on_decoded));
+    ptr->StartWorkers(num_threads);
+    return ptr;
+}
+
+MjpegDecodePool::MjpegDecodePool(int width, int height, int depth,
+                                 std::shared_ptr<FrameBufferPool> pool, OnDecodedFunc on_decoded)
+    : width_(width),
+      height_(height),
+      depth_(std::max(depth, 1)),
+      pool_(pool ? std::move(pool) : FrameBufferPool::Create()),
+      on_decoded_(std::move(on_decoded)),
+      jobs_(depth_),
+      stats_({}),
+      next_sequence_(0) {}
+
+MjpegDecodePool::~MjpegDecodePool() {
+    jobs_.shutdown();
+    workers_.clear();
+    DEBUG_PRINT("Mjpeg decode pool submitted: %llu, decoded: %llu, dropped: %llu, failed: %llu",
+                (unsigned long long)stats_.submitted, (unsigned long long)stats_.decoded,
+                (unsigned long long)stats_.dropped, (unsigned long long)stats_.failed);
+}
+
+void MjpegDecodePool::StartWorkers(int num_threads) {
+    for (int i = 0; i < std::max(num_threads, 1); i++) {
+        auto worker = std::make_unique<Worker>("MjpegDecoder", [this]() {
+            DecodeNext();
+        });
+        worker->Run();
+        workers_.push_back(std::move(worker));
+    }
+    DEBUG_PRINT("Mjpeg decode pool started %d threads, depth: %zu", std::max(num_threads, 1),
+                depth_);
+}
+
+void MjpegDecodePool::Decode(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.submitted++;
+        if (in_flight_.size() >= depth_) {
+            // Dropping here keeps the delay bounded and hands the capture buffer back at once.
+            stats_.dropped++;
+            return;
+        }
+        sequence = next_sequence_++;
+        in_flight_.insert(sequence);
+    }
+
+    if (!jobs_.push({sequence, std::move(frame_buffer)})) {
+        Complete(sequence, nullptr);
+    }
+}
+
+MjpegDecodePool::Stats MjpegDecodePool::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void MjpegDecodePool::DecodeNext() {
+    auto job = jobs_.wait_pop(std::chrono::milliseconds(100));
+    if (!job) {
+        return;
+    }
+
+    auto decoded = DecodeFrame(job->frame_buffer);
+    // Give the capture buffer back before waiting for older frames.
+    job->frame_buffer = nullptr;
+    Complete(job->sequence, decoded);
+}
+
+rtc::scoped_refptr<V4L2FrameBuffer>
+MjpegDecodePool::DecodeFrame(rtc::scoped_refptr<V4L2FrameBuffer> src) {
+    const int stride_y = width_;
+    const int stride_uv = (width_ + 1) / 2;
+    const int chroma_height = (height_ + 1) / 2;
+    const unsigned int size = stride_y * height_ + 2 * stride_uv * chroma_height;
+
+    PooledBlock data = pool_->Acquire(size);
+    uint8_t *data_y = data.get();
+    uint8_t *data_u = data_y + stride_y * height_;
+    uint8_t *data_v = data_u + stride_uv * chroma_height;
+
+    V4L2Buffer buffer = src->GetRawBuffer();
+    if (libyuv::MJPGToI420((const uint8_t *)buffer.start, buffer.length, data_y, stride_y, data_u,
+                           stride_uv, data_v, stride_uv, width_, height_, width_, height_) < 0) {
+        ERROR_PRINT("Mjpeg decoding failed");
+        return nullptr;
+    }
+
+    buffer.start = nullptr;
+    buffer.length = size;
+    return V4L2FrameBuffer::Create(width_, height_, std::move(data), buffer, V4L2_PIX_FMT_YUV420);
+}
+
+void MjpegDecodePool::Complete(uint64_t sequence, rtc::scoped_refptr<V4L2FrameBuffer> decoded) {
+    // Held while emitting, so a worker finishing a newer frame cannot overtake this one.
+    std::lock_guard<std::mutex> emit_lock(emit_mutex_);
+
+    std::vector<rtc::scoped_refptr<V4L2FrameBuffer>> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_flight_.erase(sequence);
+        finished_[sequence] = decoded;
+        if (decoded) {
+            stats_.decoded++;
+        } else {
+            stats_.failed++;
+        }
+
+        // Everything older than the oldest frame still being decoded may leave now.
+        while (!finished_.empty() &&
+               (in_flight_.empty() || finished_.begin()->first < *in_flight_.begin())) {
+            if (finished_.begin()->second) {
+                ready.push_back(finished_.begin()->second);
+            }
+            finished_.erase(finished_.begin());
+        }
+    }
+
+    for (auto &frame_buffer : ready) {
+        on_decoded_(frame_buffer);
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef MJPEG_DECODE_POOL_H_
+#define MJPEG_DECODE_POOL_H_
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include "common/bounded_queue.h"
+#include "common/frame_buffer_pool.h"
+#include "common/v4l2_frame_buffer.h"
+#include "common/worker.h"
+
+/* Decodes consecutive MJPEG frames on several threads at once and hands the I420 results on in
+ * capture order. At most `depth` frames are queued or being decoded, newer frames are dropped
+ * while the pool is that far behind. */
+class MjpegDecodePool {
+  public:
+    using OnDecodedFunc = std::function<void(rtc::scoped_refptr<V4L2FrameBuffer>)>;
+
+    struct Stats {
+        uint64_t submitted;
+        uint64_t decoded;
+        uint64_t dropped; // the pool was full when the frame arrived
+        uint64_t failed;
+    };
+
+    static std::unique_ptr<MjpegDecodePool> Create(int width, int height, int num_threads,
+                                                   int depth,
+                                                   std::shared_ptr<FrameBufferPool> pool,
+                                                   OnDecodedFunc on_decoded);
+
+    MjpegDecodePool(int width, int height, int depth, std::shared_ptr<FrameBufferPool> pool,
+                    OnDecodedFunc on_decoded);
+    ~MjpegDecodePool();
+
+    // Queues an MJPEG frame, it is held (with its lease) until a worker has decoded it.
+    void Decode(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer);
+    Stats GetStats();
+
+  private:
+    struct Job {
+        uint64_t sequence;
+        rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer;
+    };
+
+    const int width_;
+    const int height_;
+    const size_t depth_;
+    std::shared_ptr<FrameBufferPool> pool_;
+    OnDecodedFunc on_decoded_;
+    BoundedQueue<Job> jobs_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::mutex mutex_;
+    Stats stats_;
+    uint64_t next_sequence_;
+    std::set<uint64_t> in_flight_;
+    // Decoded frames waiting for an older one to finish, null if decoding failed.
+    std::map<uint64_t, rtc::scoped_refptr<V4L2FrameBuffer>> finished_;
+    // Serializes `on_decoded_` so frames leave in order.
+    std::mutex emit_mutex_;
+
+    void StartWorkers(int num_threads);
+    void DecodeNext();
+    rtc::scoped_refptr<V4L2FrameBuffer> DecodeFrame(rtc::scoped_refptr<V4L2FrameBuffer> src);
+    void Complete(uint64_t sequence, rtc::scoped_refptr<V4L2FrameBuffer> decoded);
+};
+
+#endif // MJPEG_DECODE_POOL_H_
@@ -0,0 +1,91 @@
+#include "codecs/jpeg/snapshot_cache.h"
+#include "common/logging.h"
+
+#include <algorithm>
+
+#include <api/video/i420_buffer.h>
+
+std::unique_ptr<SnapshotCache> SnapshotCache::Create(std::shared_ptr<JpegEncoder> encoder,
+                                                     size_t capacity) {
+    return std::make_unique<SnapshotCache>(std::move(encoder), capacity);
+}
+
+SnapshotCache::SnapshotCache(std::shared_ptr<JpegEncoder> encoder, size_t capacity)
+    : encoder_(std::move(encoder)),
+      capacity_(capacity),
+      next_id_(0) {}
+
+std::shared_ptr<const Buffer>
+SnapshotCache::Get(rtc::scoped_refptr<webrtc::I420BufferInterface> frame, uint64_t sequence,
+                   int quality, int width, int height) {
+    if (width <= 0 || width >= frame->width()) {
+        width = frame->width();
+        height = frame->height();
+    } else if (height <= 0) {
+        height = (width * frame->height() / frame->width() + 1) & ~1;
+    }
+    height = std::clamp(height, 1, frame->height());
+
+    std::promise<std::shared_ptr<const Buffer>> promise;
+    std::shared_future<std::shared_ptr<const Buffer>> jpeg;
+    bool is_owner = false;
+    uint64_t id = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->sequence == sequence && it->quality == quality && it->width == width &&
+                it->height == height) {
+                entries_.splice(entries_.begin(), entries_, it);
+                jpeg = it->jpeg;
+                break;
+            }
+        }
+        if (!jpeg.valid()) {
+            is_owner = true;
+            id = next_id_++;
+            jpeg = promise.get_future().share();
+            entries_.push_front({id, sequence, quality, width, height, jpeg});
+            if (entries_.size() > capacity_) {
+                entries_.pop_back();
+            }
+        }
+    }
+
+    if (is_owner) {
+        try {
+            auto buffer = Encode(frame, quality, width, height);
+            if (!buffer) {
+                Remove(id);
+            }
+            promise.set_value(buffer);
+        } catch (...) {
+            Remove(id);
+            promise.set_exception(std::current_exception());
+        }
+    }
+    // Others wait here for the caller that created the entry.
+    return jpeg.get();
+}
+
+void SnapshotCache::Remove(uint64_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.remove_if([id](const Entry &entry) {
+        return entry.id == id;
+    });
+}
+
+std::shared_ptr<const Buffer>
+SnapshotCache::Encode(rtc::scoped_refptr<webrtc::I420BufferInterface> frame, int quality,
+                      int width, int height) {
+    if (width != frame->width() || height != frame->height()) {
+        auto scaled = webrtc::I420Buffer::Create(width, height);
+        scaled->ScaleFrom(*frame);
+        frame = scaled;
+    }
+    DEBUG_PRINT("Encode a %dx%d snapshot at quality %d.", width, height, quality);
+    auto buffer = encoder_->Encode(frame, quality);
+    if (!buffer.start || buffer.length == 0) {
+        return nullptr;
+    }
+    return std::make_shared<const Buffer>(std::move(buffer));
+}
@@ -0,0 +1,51 @@
+#ifndef SNAPSHOT_CACHE_H_
+#define SNAPSHOT_CACHE_H_
+
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+
+#include <api/video/video_frame_buffer.h>
+
+#include "codecs/jpeg/jpeg_encoder.h"
+#include "common/utils.h"
+
+/* Keeps the jpegs of the last few snapshots so viewers polling the same frame share one encode.
+ * Frames are identified by their capture sequence, only the compressed bytes are kept. */
+class SnapshotCache {
+  public:
+    static std::unique_ptr<SnapshotCache> Create(std::shared_ptr<JpegEncoder> encoder,
+                                                 size_t capacity = 4);
+
+    SnapshotCache(std::shared_ptr<JpegEncoder> encoder, size_t capacity);
+
+    /* Returns the jpeg of `frame` at `quality`, downscaled to `width`x`height` when that is smaller
+     * than the frame. A zero `height` keeps the aspect ratio. Concurrent calls for the same key
+     * wait for the first one's encode. Returns null if the encode failed, failures are not kept. */
+    std::shared_ptr<const Buffer> Get(rtc::scoped_refptr<webrtc::I420BufferInterface> frame,
+                                      uint64_t sequence, int quality, int width = 0,
+                                      int height = 0);
+
+  private:
+    struct Entry {
+        uint64_t id;
+        uint64_t sequence;
+        int quality;
+        int width;
+        int height;
+        std::shared_future<std::shared_ptr<const Buffer>> jpeg;
+    };
+
+    std::shared_ptr<JpegEncoder> encoder_;
+    size_t capacity_;
+    std::mutex mutex_;
+    uint64_t next_id_;
+    std::list<Entry> entries_; // most recently used first
+
+    std::shared_ptr<const Buffer> Encode(rtc::scoped_refptr<webrtc::I420BufferInterface> frame,
+                                         int quality, int width, int height);
+    void Remove(uint64_t id);
+};
+
+#endif // SNAPSHOT_CACHE_H_
@@ -1,15 +1,27 @@
 #include "codecs/v4l2/v4l2_codec.h"
 #include "common/logging.h"
+#include <chrono>
 #include <cstring>
-#include <thread>
+#include <sys/epoll.h>
+
+// How long `Backpressure::Block` waits for the device before dropping the input.
+static const std::chrono::milliseconds kBlockTimeout(200);
 
 V4L2Codec::V4L2Codec()
     : fd_(0),
-      abort_(false) {}
+      backpressure_(Backpressure::DropNewest),
+      stats_({}),
+      next_sequence_(0),
+      free_output_indices_(VIDEO_MAX_FRAME) {}
 
 V4L2Codec::~V4L2Codec() {
-    abort_ = true;
-    worker_.reset();
+    if (reactor_) {
+        reactor_->RemoveFd(fd_);
+    }
+    DEBUG_PRINT("%s submitted %llu, completed %llu, dropped %llu newest / %llu oldest, lost %llu",
+                file_name_, (unsigned long long)stats_.submitted,
+                (unsigned long long)stats_.completed, (unsigned long long)stats_.dropped_newest,
+                (unsigned long long)stats_.dropped_oldest, (unsigned long long)stats_.lost);
     V4L2Util::StreamOff(fd_, output_.type);
     V4L2Util::StreamOff(fd_, capture_.type);
 
@@ -30,12 +42,12 @@ bool V4L2Codec::Open(const char *file_name) {
 
 bool V4L2Codec::PrepareBuffer(V4L2BufferGroup *gbuffer, int width, int height, uint32_t pix_fmt,
                               v4l2_buf_type type, v4l2_memory memory, int buffer_num,
-                              bool has_dmafd) {
+                              bool has_dmafd, int stride) {
     if (!V4L2Util::InitBuffer(fd_, gbuffer, type, memory, has_dmafd)) {
         return false;
     }
 
-    if (!V4L2Util::SetFormat(fd_, gbuffer, width, height, pix_fmt)) {
+    if (!V4L2Util::SetFormat(fd_, gbuffer, width, height, pix_fmt, stride)) {
         return false;
     }
 
@@ -45,7 +57,7 @@ bool V4L2Codec::PrepareBuffer(V4L2BufferGroup *gbuffer, int width, int height, u
 
     if (type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) {
         for (int i = 0; i < buffer_num; i++) {
-            output_buffer_index_.push(i);
+            free_output_indices_.push(i);
         }
     } else if (type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE) {
         if (!V4L2Util::QueueBuffers(fd_, gbuffer)) {
@@ -57,65 +69,188 @@ bool V4L2Codec::PrepareBuffer(V4L2BufferGroup *gbuffer, int width, int height, u
 }
 
 void V4L2Codec::Start() {
-    abort_ = false;
-    worker_ = std::make_unique<Worker>(file_name_ + std::to_string(pthread_self()), [this]() {
-        CaptureBuffer();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // Every output and capture buffer may hold an input that is yet to complete.
+        slots_.resize(output_.num_buffers + capture_.num_buffers);
+    }
+
+    reactor_ = Reactor::Acquire();
+    // EPOLLOUT reports output buffers the device is done with, waking up `Backpressure::Block`.
+    reactor_->AddFd(fd_, EPOLLIN | EPOLLOUT | EPOLLPRI, file_name_, [this](uint32_t events) {
+        HandleDeviceEvent(events);
     });
-    worker_->Run();
 }
 
-void V4L2Codec::EmplaceBuffer(V4L2Buffer &buffer, std::function<void(V4L2Buffer &)> on_capture) {
-    auto item = output_buffer_index_.pop();
-    if (!item) {
-        return;
+void V4L2Codec::SetBackpressure(Backpressure backpressure) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    backpressure_ = backpressure;
+}
+
+V4L2Codec::Stats V4L2Codec::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void V4L2Codec::EmplaceBuffer(V4L2Buffer &buffer, CaptureFunc on_capture) {
+    Backpressure backpressure;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.submitted++;
+        backpressure = backpressure_;
     }
-    auto index = item.value();
 
+    // A decoder may hold several inputs before it emits anything, pick up the ones it is done
+    // with instead of waiting for the next capture event.
+    ReclaimOutputBuffers();
+    auto index = free_output_indices_.try_pop();
+
+    if (!index && backpressure == Backpressure::Block && reactor_->IsCurrent()) {
+        // Only the reactor thread hands output buffers back, waiting here would never end.
+        backpressure = Backpressure::DropNewest;
+    }
+
+    if (!index && backpressure == Backpressure::DropOldest &&
+        output_.memory == V4L2_MEMORY_DMABUF) {
+        // The source recycles its dmafd once this returns, it cannot be kept aside.
+        backpressure = Backpressure::DropNewest;
+    }
+
+    if (!index && backpressure == Backpressure::Block) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.blocked++;
+        }
+        index = free_output_indices_.wait_pop(kBlockTimeout);
+    }
+
+    if (index) {
+        QueueInput(index.value(), buffer, on_capture);
+    } else if (backpressure == Backpressure::DropOldest) {
+        StashInput(buffer, on_capture);
+    } else {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.dropped_newest++;
+    }
+}
+
+bool V4L2Codec::QueueInput(int index, const V4L2Buffer &buffer, CaptureFunc &on_capture) {
+    int slot_index;
+    uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot_index = AcquireSlot();
+        Slot &slot = slots_[slot_index];
+        slot.on_capture = std::move(on_capture);
+        slot.timestamp = buffer.timestamp;
+        sequence = slot.sequence;
+    }
+
+    // The output buffer at `index` is owned by this call until it is queued.
+    v4l2_buffer *buf = &output_.buffers[index].inner;
     if (output_.memory == V4L2_MEMORY_DMABUF) {
-        v4l2_buffer *buf = &output_.buffers[index].inner;
         buf->m.planes[0].m.fd = buffer.dmafd;
         buf->m.planes[0].bytesused = buffer.length;
         buf->m.planes[0].length = buffer.length;
     } else {
         memcpy((uint8_t *)output_.buffers[index].start, (uint8_t *)buffer.start, buffer.length);
     }
+    buf->timestamp.tv_sec = sequence;
+    buf->timestamp.tv_usec = slot_index;
 
-    if (!V4L2Util::QueueBuffer(fd_, &output_.buffers[index].inner)) {
+    if (!V4L2Util::QueueBuffer(fd_, buf)) {
         ERROR_PRINT("QueueBuffer V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE. fd(%d) at index %d", fd_,
                     index);
-        output_buffer_index_.push(index);
-        return;
+        free_output_indices_.push(index);
+        std::lock_guard<std::mutex> lock(mutex_);
+        Slot &slot = slots_[slot_index];
+        if (slot.in_use && slot.sequence == sequence) {
+            slot.in_use = false;
+            slot.on_capture = nullptr;
+        }
+        return false;
+    }
+    return true;
+}
+
+void V4L2Codec::StashInput(const V4L2Buffer &buffer, CaptureFunc &on_capture) {
+    {
+        std::lock_guard<std::mutex> lock(pending_mutex_);
+        if (pending_.valid) {
+            std::lock_guard<std::mutex> stats_lock(mutex_);
+            stats_.dropped_oldest++;
+        }
+
+        // Sized once to the largest input, then reused.
+        if (pending_.data.size() < buffer.length) {
+            pending_.data.resize(buffer.length);
+        }
+        memcpy(pending_.data.data(), buffer.start, buffer.length);
+        pending_.length = buffer.length;
+        pending_.flags = buffer.flags;
+        pending_.timestamp = buffer.timestamp;
+        pending_.on_capture = std::move(on_capture);
+        pending_.valid = true;
     }
 
-    capturing_tasks_.push(on_capture);
+    // A buffer may have come back while this input was on its way here.
+    SubmitPendingInput();
 }
 
-bool V4L2Codec::CaptureBuffer() {
+int V4L2Codec::AcquireSlot() {
+    int oldest = 0;
+    for (int i = 0; i < (int)slots_.size(); i++) {
+        if (!slots_[i].in_use) {
+            oldest = i;
+            break;
+        }
+        if (slots_[i].sequence < slots_[oldest].sequence) {
+            oldest = i;
+        }
+    }
 
-    if (abort_) {
-        return false;
+    Slot &slot = slots_[oldest];
+    if (slot.in_use) {
+        // The device skipped that input, e.g. a decoder consuming headers without a picture.
+        stats_.lost++;
     }
+    slot.in_use = true;
+    slot.sequence = next_sequence_++;
+    return oldest;
+}
 
-    fd_set fds[2];
-    fd_set *rd_fds = &fds[0]; /* for capture */
-    fd_set *ex_fds = &fds[1]; /* for handle event */
-    FD_ZERO(rd_fds);
-    FD_SET(fd_, rd_fds);
-    FD_ZERO(ex_fds);
-    FD_SET(fd_, ex_fds);
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 200000;
+int V4L2Codec::FindSlot(const struct timeval &timestamp) {
+    int index = timestamp.tv_usec;
+    if (index >= 0 && index < (int)slots_.size() && slots_[index].in_use &&
+        slots_[index].sequence == (uint64_t)timestamp.tv_sec) {
+        return index;
+    }
 
-    int r = select(fd_ + 1, rd_fds, NULL, ex_fds, &tv);
+    // Either the driver did not copy the timestamp or the slot was handed to a newer input,
+    // guessing would complete it with another frame's context.
+    return -1;
+}
 
-    if (abort_) {
-        return false;
-    } else if (r <= 0) { // failed or timeout
-        return false;
+void V4L2Codec::HandleDeviceEvent(uint32_t events) {
+    if (events & EPOLLPRI) {
+        HandleEvent();
+    }
+
+    if (events & (EPOLLIN | EPOLLOUT)) {
+        ReclaimOutputBuffers();
+    }
+
+    if (events & EPOLLIN) {
+        CaptureBuffers();
     }
 
-    if (rd_fds && FD_ISSET(fd_, rd_fds)) {
+    if (events & EPOLLERR) {
+        ERROR_PRINT("Exception in fd(%d).", fd_);
+    }
+}
+
+void V4L2Codec::ReclaimOutputBuffers() {
+    while (true) {
         struct v4l2_buffer buf = {0};
         struct v4l2_plane planes = {0};
         buf.memory = output_.memory;
@@ -123,18 +258,40 @@ bool V4L2Codec::CaptureBuffer() {
         buf.m.planes = &planes;
         buf.type = output_.type;
         if (!V4L2Util::DequeueBuffer(fd_, &buf)) {
-            return false;
+            break;
         }
-        output_buffer_index_.push(buf.index);
+        free_output_indices_.push(buf.index);
+    }
+
+    SubmitPendingInput();
+}
 
-        buf = {};
-        planes = {};
+void V4L2Codec::SubmitPendingInput() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (!pending_.valid) {
+        return;
+    }
+
+    auto index = free_output_indices_.try_pop();
+    if (!index) {
+        return;
+    }
+
+    V4L2Buffer buffer(pending_.data.data(), pending_.length, pending_.flags, pending_.timestamp);
+    pending_.valid = false;
+    QueueInput(index.value(), buffer, pending_.on_capture);
+}
+
+void V4L2Codec::CaptureBuffers() {
+    while (true) {
+        struct v4l2_buffer buf = {0};
+        struct v4l2_plane planes = {0};
         buf.memory = capture_.memory;
         buf.length = 1;
         buf.m.planes = &planes;
         buf.type = capture_.type;
         if (!V4L2Util::DequeueBuffer(fd_, &buf)) {
-            return false;
+            return;
         }
 
         V4L2Buffer buffer;
@@ -143,25 +300,29 @@ bool V4L2Codec::CaptureBuffer() {
         buffer.dmafd = capture_.buffers[buf.index].dmafd;
         buffer.flags = buf.flags;
 
-        if (abort_) {
-            return false;
+        CaptureFunc on_capture;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            int slot_index = FindSlot(buf.timestamp);
+            if (slot_index >= 0) {
+                Slot &slot = slots_[slot_index];
+                buffer.timestamp = slot.timestamp;
+                on_capture = std::move(slot.on_capture);
+                slot.on_capture = nullptr;
+                slot.in_use = false;
+                stats_.completed++;
+            } else {
+                ERROR_PRINT("fd(%d) capture buffer(%u) matches no queued input, sequence %ld.",
+                            fd_, buf.index, (long)buf.timestamp.tv_sec);
+            }
         }
 
-        auto item = capturing_tasks_.pop();
-        if (item) {
-            auto task = item.value();
-            task(buffer);
+        if (on_capture) {
+            on_capture(buffer);
         }
 
         if (!V4L2Util::QueueBuffer(fd_, &capture_.buffers[buf.index].inner)) {
-            return false;
+            return;
         }
     }
-
-    if (ex_fds && FD_ISSET(fd_, ex_fds)) {
-        ERROR_PRINT("Exception in fd(%d).", fd_);
-        HandleEvent();
-    }
-
-    return true;
 }
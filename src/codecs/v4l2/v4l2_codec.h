@@ -1,15 +1,46 @@
 #ifndef V4L2_CODEC_
 #define V4L2_CODEC_
 
-#include "common/thread_safe_queue.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <api/video/video_frame.h>
+
+#include "common/bounded_queue.h"
+#include "common/inline_function.h"
+#include "common/reactor.h"
 #include "common/v4l2_utils.h"
-#include "common/worker.h"
 
 class V4L2Codec {
   public:
+    /* What `EmplaceBuffer` does when every output buffer is still owned by the device. */
+    enum class Backpressure {
+        Block,      // wait for a free buffer, drops the input when called on the reactor thread
+        DropNewest, // discard the incoming buffer
+        DropOldest, // keep the incoming buffer aside, replacing one that was waiting already;
+                    // DMABUF inputs are not owned past the call and fall back to DropNewest
+    };
+
+    struct Stats {
+        uint64_t submitted;
+        uint64_t completed;
+        uint64_t dropped_newest;
+        uint64_t dropped_oldest;
+        uint64_t blocked;
+        uint64_t lost; // inputs the device never produced a capture buffer for
+    };
+
+    // Stored in place, queueing a frame never allocates. Large enough for the biggest completion
+    // context in the tree, a `webrtc::VideoFrame` next to its owner.
+    using CaptureFunc =
+        InlineFunction<void(V4L2Buffer &), sizeof(webrtc::VideoFrame) + 2 * sizeof(void *)>;
+
     V4L2Codec();
     ~V4L2Codec();
-    void EmplaceBuffer(V4L2Buffer &buffer, std::function<void(V4L2Buffer &)> on_capture);
+    void EmplaceBuffer(V4L2Buffer &buffer, CaptureFunc on_capture);
+    void SetBackpressure(Backpressure backpressure);
+    Stats GetStats();
 
   protected:
     int fd_;
@@ -20,16 +51,47 @@ class V4L2Codec {
     bool Open(const char *file_name);
     bool PrepareBuffer(V4L2BufferGroup *gbuffer, int width, int height, uint32_t pix_fmt,
                        v4l2_buf_type type, v4l2_memory memory, int buffer_num,
-                       bool has_dmafd = false);
+                       bool has_dmafd = false, int stride = 0);
     void Start();
 
   private:
-    std::atomic<bool> abort_;
-    std::unique_ptr<Worker> worker_;
-    ThreadSafeQueue<int> output_buffer_index_;
-    ThreadSafeQueue<std::function<void(V4L2Buffer &)>> capturing_tasks_;
+    /* Completion context of a queued input. Its index and sequence travel through the device in
+     * the v4l2 timestamp, which m2m drivers copy from the output to the capture buffer. */
+    struct Slot {
+        bool in_use = false;
+        uint64_t sequence = 0;
+        struct timeval timestamp = {0, 0};
+        CaptureFunc on_capture;
+    };
+
+    struct Pending {
+        bool valid = false;
+        unsigned int length = 0;
+        unsigned int flags = 0;
+        struct timeval timestamp = {0, 0};
+        std::vector<uint8_t> data;
+        CaptureFunc on_capture;
+    };
+
+    std::shared_ptr<Reactor> reactor_;
     const char *file_name_;
-    bool CaptureBuffer();
+    Backpressure backpressure_;
+    Stats stats_;
+    uint64_t next_sequence_;
+    std::mutex mutex_; // guards the slots and stats, never held across device calls
+    BoundedQueue<int> free_output_indices_;
+    std::vector<Slot> slots_;
+    std::mutex pending_mutex_; // taken before mutex_
+    Pending pending_;
+
+    void HandleDeviceEvent(uint32_t events);
+    void ReclaimOutputBuffers();
+    void CaptureBuffers();
+    bool QueueInput(int index, const V4L2Buffer &buffer, CaptureFunc &on_capture);
+    void StashInput(const V4L2Buffer &buffer, CaptureFunc &on_capture);
+    void SubmitPendingInput();
+    int AcquireSlot();
+    int FindSlot(const struct timeval &timestamp);
 };
 
 #endif // V4L2_CODEC_
@@ -8,7 +8,11 @@
 
 class V4L2Encoder : public V4L2Codec {
   public:
-    static std::unique_ptr<V4L2Encoder> Create(int width, int height, bool is_dma_src);
+    static std::unique_ptr<V4L2Encoder> Create(int width, int height, bool is_dma_src,
+                                               uint32_t src_pix_fmt = V4L2_PIX_FMT_YUV420,
+                                               int src_stride = 0);
+    // Raw formats the encoder takes as they are, anything else goes through the scaler first.
+    static bool IsSupportedSourceFormat(uint32_t pix_fmt);
     V4L2Encoder();
 
     void SetBitrate(uint32_t adjusted_bitrate_bps);
@@ -19,7 +23,8 @@ class V4L2Encoder : public V4L2Codec {
     int framerate_;
     int bitrate_bps_;
 
-    bool Configure(int width, int height, bool is_dma_src);
+    bool Configure(int width, int height, bool is_dma_src, uint32_t src_pix_fmt,
+                   int src_stride);
 };
 
 #endif // V4L2_ENCODER_H_
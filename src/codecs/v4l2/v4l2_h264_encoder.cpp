@@ -2,16 +2,28 @@
 #include "common/logging.h"
 #include "common/v4l2_frame_buffer.h"
 
+#include <third_party/libyuv/include/libyuv.h>
+
 std::unique_ptr<webrtc::VideoEncoder> V4L2H264Encoder::Create(Args args) {
     return std::make_unique<V4L2H264Encoder>(args);
 }
 
 V4L2H264Encoder::V4L2H264Encoder(Args args)
-    : fps_adjuster_(args.fps),
+    : width_(0),
+      height_(0),
+      fps_adjuster_(args.fps),
+      subscription_id_(-1),
       is_dma_(!args.fixed_resolution),
+      // Only unscaled frames reach the encoder in the capture format.
+      src_pix_fmt_(args.fixed_resolution && V4L2Encoder::IsSupportedSourceFormat(args.format)
+                       ? args.format
+                       : V4L2_PIX_FMT_YUV420),
+      src_stride_(0),
       bitrate_adjuster_(.85, 1),
       callback_(nullptr) {}
 
+V4L2H264Encoder::~V4L2H264Encoder() { Release(); }
+
 int32_t V4L2H264Encoder::InitEncode(const webrtc::VideoCodec *codec_settings,
                                     const VideoEncoder::Settings &settings) {
     codec_ = *codec_settings;
@@ -26,26 +38,56 @@ int32_t V4L2H264Encoder::InitEncode(const webrtc::VideoCodec *codec_settings,
         return WEBRTC_VIDEO_CODEC_ERROR;
     }
 
-    encoder_ = V4L2Encoder::Create(width_, height_, is_dma_);
+    // WebRTC registers the callback after this, encoded frames must not arrive before it.
+    src_stride_ = 0;
+    if (callback_) {
+        AcquireEncoder(src_stride_);
+    }
 
     return WEBRTC_VIDEO_CODEC_OK;
 }
 
+void V4L2H264Encoder::AcquireEncoder(int src_stride) {
+    Release();
+    src_stride_ = src_stride;
+    encoder_ = V4L2SharedEncoder::Acquire(width_, height_, is_dma_, src_pix_fmt_, src_stride_);
+    subscription_id_ =
+        encoder_->Subscribe([this](const webrtc::VideoFrame &frame, V4L2Buffer &encoded_buffer) {
+            SendFrame(frame, encoded_buffer);
+        });
+    encoder_->SetRates(subscription_id_, bitrate_adjuster_.GetAdjustedBitrateBps(),
+                       fps_adjuster_);
+}
+
 int32_t V4L2H264Encoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback *callback) {
-    callback_ = callback;
+    {
+        std::lock_guard<std::mutex> lock(callback_mutex_);
+        callback_ = callback;
+    }
+    if (callback && !encoder_ && width_ > 0) {
+        AcquireEncoder(src_stride_);
+    }
     return WEBRTC_VIDEO_CODEC_OK;
 }
 
 int32_t V4L2H264Encoder::Release() {
+    if (encoder_) {
+        encoder_->UnSubscribe(subscription_id_);
+    }
     encoder_.reset();
     return WEBRTC_VIDEO_CODEC_OK;
 }
 
 int32_t V4L2H264Encoder::Encode(const webrtc::VideoFrame &frame,
                                 const std::vector<webrtc::VideoFrameType> *frame_types) {
+    if (!encoder_) {
+        return WEBRTC_VIDEO_CODEC_UNINITIALIZED;
+    }
+
+    bool is_key_frame = false;
     if (frame_types) {
         if ((*frame_types)[0] == webrtc::VideoFrameType::kVideoFrameKey) {
-            V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
+            is_key_frame = true;
         } else if ((*frame_types)[0] == webrtc::VideoFrameType::kEmptyFrame) {
             return WEBRTC_VIDEO_CODEC_OK;
         }
@@ -57,6 +99,22 @@ int32_t V4L2H264Encoder::Encode(const webrtc::VideoFrame &frame,
     if (frame_buffer->type() == webrtc::VideoFrameBuffer::Type::kNative) {
         V4L2FrameBuffer *raw_buffer = static_cast<V4L2FrameBuffer *>(frame_buffer.get());
         src_buffer = raw_buffer->GetRawBuffer();
+        // Padded camera rows are passed on as they are, the device is told their stride.
+        int src_stride = src_buffer.stride == raw_buffer->width() ? 0 : src_buffer.stride;
+        if (!is_dma_ && src_stride != src_stride_) {
+            AcquireEncoder(src_stride);
+        }
+    } else if (src_pix_fmt_ == V4L2_PIX_FMT_NV12) {
+        // Frames WebRTC produced itself are I420, bring them into the layout the device expects.
+        auto i420_buffer = frame_buffer->ToI420();
+        nv12_buffer_.resize(width_ * height_ + ((width_ + 1) / 2) * ((height_ + 1) / 2) * 2);
+        uint8_t *dst_uv = nv12_buffer_.data() + width_ * height_;
+        libyuv::I420ToNV12(i420_buffer->DataY(), i420_buffer->StrideY(), i420_buffer->DataU(),
+                           i420_buffer->StrideU(), i420_buffer->DataV(), i420_buffer->StrideV(),
+                           nv12_buffer_.data(), width_, dst_uv, width_, width_, height_);
+
+        src_buffer.start = nv12_buffer_.data();
+        src_buffer.length = nv12_buffer_.size();
     } else {
         auto i420_buffer = frame_buffer->GetI420();
         unsigned int i420_buffer_size =
@@ -67,9 +125,7 @@ int32_t V4L2H264Encoder::Encode(const webrtc::VideoFrame &frame,
         src_buffer.length = i420_buffer_size;
     }
 
-    encoder_->EmplaceBuffer(src_buffer, [this, frame](V4L2Buffer encoded_buffer) {
-        SendFrame(frame, encoded_buffer);
-    });
+    encoder_->Encode(frame, src_buffer, is_key_frame);
 
     return WEBRTC_VIDEO_CODEC_OK;
 }
@@ -81,8 +137,10 @@ void V4L2H264Encoder::SetRates(const RateControlParameters &parameters) {
     bitrate_adjuster_.SetTargetBitrateBps(parameters.bitrate.get_sum_bps());
     fps_adjuster_ = parameters.framerate_fps;
 
-    encoder_->SetFps(fps_adjuster_);
-    encoder_->SetBitrate(bitrate_adjuster_.GetAdjustedBitrateBps());
+    if (encoder_) {
+        encoder_->SetRates(subscription_id_, bitrate_adjuster_.GetAdjustedBitrateBps(),
+                           fps_adjuster_);
+    }
 }
 
 webrtc::VideoEncoder::EncoderInfo V4L2H264Encoder::GetEncoderInfo() const {
@@ -115,6 +173,10 @@ void V4L2H264Encoder::SendFrame(const webrtc::VideoFrame &frame, V4L2Buffer &enc
                                     ? webrtc::VideoFrameType::kVideoFrameKey
                                     : webrtc::VideoFrameType::kVideoFrameDelta;
 
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    if (!callback_) {
+        return;
+    }
     auto result = callback_->OnEncodedImage(encoded_image_, &codec_specific);
     if (result.error != webrtc::EncodedImageCallback::Result::OK) {
         ERROR_PRINT("Failed to send the frame => %d", result.error);
@@ -1,13 +1,15 @@
 #ifndef V4L2_H264_ENCODER_H_
 #define V4L2_H264_ENCODER_H_
 
+#include <mutex>
+
 // WebRTC
 #include <api/video_codecs/video_encoder.h>
 #include <common_video/include/bitrate_adjuster.h>
 #include <modules/video_coding/codecs/h264/include/h264.h>
 
 #include "args.h"
-#include "codecs/v4l2/v4l2_encoder.h"
+#include "codecs/v4l2/v4l2_shared_encoder.h"
 
 class V4L2H264Encoder : public webrtc::VideoEncoder {
   public:
@@ -23,18 +25,26 @@ class V4L2H264Encoder : public webrtc::VideoEncoder {
     void SetRates(const RateControlParameters &parameters) override;
     webrtc::VideoEncoder::EncoderInfo GetEncoderInfo() const override;
 
+    ~V4L2H264Encoder();
+
   protected:
     int width_;
     int height_;
     int fps_adjuster_;
+    int subscription_id_;
     bool is_dma_;
+    uint32_t src_pix_fmt_;
+    int src_stride_;
+    std::vector<uint8_t> nv12_buffer_;
     std::string name_;
     webrtc::VideoCodec codec_;
     webrtc::EncodedImage encoded_image_;
+    std::mutex callback_mutex_;
     webrtc::EncodedImageCallback *callback_;
     webrtc::BitrateAdjuster bitrate_adjuster_;
-    std::unique_ptr<V4L2Encoder> encoder_;
+    std::shared_ptr<V4L2SharedEncoder> encoder_;
 
+    void AcquireEncoder(int src_stride);
     virtual void SendFrame(const webrtc::VideoFrame &frame, V4L2Buffer &encoded_buffer);
 };
 
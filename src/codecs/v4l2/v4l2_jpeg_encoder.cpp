@@ -0,0 +1,70 @@
+#include "codecs/v4l2/v4l2_jpeg_encoder.h"
+#include "common/logging.h"
+
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+const char *V4L2JpegEncoder::kDefaultFile = "/dev/video31";
+const int BUFFER_NUM = 1;
+
+bool V4L2JpegEncoder::IsAvailable(const char *file, uint32_t dst_pix_fmt) {
+    // Probed without `V4L2Util::OpenDevice`, a missing device is not an error here.
+    int fd = open(file, O_RDWR | O_NONBLOCK);
+    if (fd < 0) {
+        return false;
+    }
+
+    bool has_format = false;
+    v4l2_fmtdesc fmtdesc = {};
+    fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    while (!has_format && ioctl(fd, VIDIOC_ENUM_FMT, &fmtdesc) == 0) {
+        has_format = fmtdesc.pixelformat == dst_pix_fmt;
+        fmtdesc.index++;
+    }
+    close(fd);
+    return has_format;
+}
+
+V4L2JpegEncoder::V4L2JpegEncoder()
+    : quality_(-1) {}
+
+std::unique_ptr<V4L2JpegEncoder> V4L2JpegEncoder::Create(int width, int height, bool is_dma_src,
+                                                         const char *file,
+                                                         uint32_t dst_pix_fmt) {
+    auto encoder = std::make_unique<V4L2JpegEncoder>();
+    if (!encoder->Configure(width, height, is_dma_src, file, dst_pix_fmt)) {
+        return nullptr;
+    }
+    encoder->Start();
+    return encoder;
+}
+
+bool V4L2JpegEncoder::Configure(int width, int height, bool is_dma_src, const char *file,
+                                uint32_t dst_pix_fmt) {
+    if (!Open(file)) {
+        DEBUG_PRINT("Failed to turn on jpeg encoder: %s", file);
+        return false;
+    }
+
+    auto src_memory = is_dma_src ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
+    if (!PrepareBuffer(&output_, width, height, V4L2_PIX_FMT_YUV420,
+                       V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, src_memory, BUFFER_NUM) ||
+        !PrepareBuffer(&capture_, width, height, dst_pix_fmt, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+                       V4L2_MEMORY_MMAP, BUFFER_NUM)) {
+        return false;
+    }
+
+    V4L2Util::StreamOn(fd_, output_.type);
+    V4L2Util::StreamOn(fd_, capture_.type);
+
+    return true;
+}
+
+void V4L2JpegEncoder::SetQuality(int quality) {
+    if (quality == quality_) {
+        return;
+    }
+    quality_ = quality;
+    V4L2Util::SetCtrl(fd_, V4L2_CID_JPEG_COMPRESSION_QUALITY, quality);
+}
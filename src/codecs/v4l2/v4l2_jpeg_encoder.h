@@ -0,0 +1,29 @@
+#ifndef V4L2_JPEG_ENCODER_H_
+#define V4L2_JPEG_ENCODER_H_
+
+#include "codecs/v4l2/v4l2_codec.h"
+
+class V4L2JpegEncoder : public V4L2Codec {
+  public:
+    static const char *kDefaultFile;
+
+    // Whether `file` is an m2m device turning I420 into `dst_pix_fmt`, e.g. the Pi's JPEG
+    // encoder, or vicodec with V4L2_PIX_FMT_FWHT for testing.
+    static bool IsAvailable(const char *file = kDefaultFile,
+                            uint32_t dst_pix_fmt = V4L2_PIX_FMT_JPEG);
+    // Returns null if the device cannot be configured for this size.
+    static std::unique_ptr<V4L2JpegEncoder> Create(int width, int height, bool is_dma_src,
+                                                   const char *file = kDefaultFile,
+                                                   uint32_t dst_pix_fmt = V4L2_PIX_FMT_JPEG);
+
+    V4L2JpegEncoder();
+    void SetQuality(int quality);
+
+  private:
+    int quality_;
+
+    bool Configure(int width, int height, bool is_dma_src, const char *file,
+                   uint32_t dst_pix_fmt);
+};
+
+#endif // V4L2_JPEG_ENCODER_H_
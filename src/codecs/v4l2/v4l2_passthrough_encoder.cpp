@@ -0,0 +1,122 @@
+#include "codecs/v4l2/v4l2_passthrough_encoder.h"
+#include "common/logging.h"
+#include "common/v4l2_frame_buffer.h"
+
+std::unique_ptr<webrtc::VideoEncoder>
+V4L2PassthroughEncoder::Create(RequestKeyFrameFunc request_key_frame) {
+    return std::make_unique<V4L2PassthroughEncoder>(std::move(request_key_frame));
+}
+
+V4L2PassthroughEncoder::V4L2PassthroughEncoder(RequestKeyFrameFunc request_key_frame)
+    : has_first_keyframe_(false),
+      last_sequence_(0),
+      callback_(nullptr),
+      request_key_frame_(std::move(request_key_frame)) {}
+
+int32_t V4L2PassthroughEncoder::InitEncode(const webrtc::VideoCodec *codec_settings,
+                                           const VideoEncoder::Settings &settings) {
+    codec_ = *codec_settings;
+
+    if (codec_.codecType != webrtc::kVideoCodecH264) {
+        return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    encoded_image_.timing_.flags = webrtc::VideoSendTiming::TimingFrameFlags::kInvalid;
+    encoded_image_.content_type_ = webrtc::VideoContentType::UNSPECIFIED;
+
+    has_first_keyframe_ = false;
+    if (request_key_frame_) {
+        request_key_frame_();
+    }
+
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t V4L2PassthroughEncoder::RegisterEncodeCompleteCallback(
+    webrtc::EncodedImageCallback *callback) {
+    callback_ = callback;
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t V4L2PassthroughEncoder::Release() { return WEBRTC_VIDEO_CODEC_OK; }
+
+int32_t V4L2PassthroughEncoder::Encode(const webrtc::VideoFrame &frame,
+                                       const std::vector<webrtc::VideoFrameType> *frame_types) {
+    if (frame_types) {
+        if ((*frame_types)[0] == webrtc::VideoFrameType::kVideoFrameKey && request_key_frame_) {
+            request_key_frame_();
+        } else if ((*frame_types)[0] == webrtc::VideoFrameType::kEmptyFrame) {
+            return WEBRTC_VIDEO_CODEC_OK;
+        }
+    }
+
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer = frame.video_frame_buffer();
+    if (frame_buffer->type() != webrtc::VideoFrameBuffer::Type::kNative) {
+        ERROR_PRINT("Passthrough encoder only accepts native h264 frames.");
+        return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    V4L2FrameBuffer *raw_buffer = static_cast<V4L2FrameBuffer *>(frame_buffer.get());
+    if (raw_buffer->format() != V4L2_PIX_FMT_H264) {
+        ERROR_PRINT("Passthrough encoder only accepts native h264 frames.");
+        return WEBRTC_VIDEO_CODEC_ERROR;
+    }
+
+    V4L2Buffer buffer = raw_buffer->GetRawBuffer();
+    bool is_key_frame = (buffer.flags & V4L2_BUF_FLAG_KEYFRAME) != 0;
+    uint32_t sequence = buffer.inner.sequence;
+    if (has_first_keyframe_ && !is_key_frame && sequence != last_sequence_ + 1) {
+        // A frame was dropped before it got here, every P-frame up to the next IDR would
+        // reference it.
+        DEBUG_PRINT("Passthrough frame %u is missing, wait for a key frame.", last_sequence_ + 1);
+        has_first_keyframe_ = false;
+        if (request_key_frame_) {
+            request_key_frame_();
+        }
+    }
+    last_sequence_ = sequence;
+    if (!has_first_keyframe_ && !is_key_frame) {
+        // the remote decoder can't start from a P-frame.
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+    has_first_keyframe_ = true;
+
+    webrtc::CodecSpecificInfo codec_specific;
+    codec_specific.codecType = webrtc::kVideoCodecH264;
+    codec_specific.codecSpecific.H264.packetization_mode =
+        webrtc::H264PacketizationMode::NonInterleaved;
+
+    encoded_image_.SetEncodedData(
+        webrtc::EncodedImageBuffer::Create((uint8_t *)buffer.start, buffer.length));
+    encoded_image_.SetTimestamp(frame.timestamp());
+    encoded_image_.SetColorSpace(frame.color_space());
+    encoded_image_._encodedWidth = frame.width();
+    encoded_image_._encodedHeight = frame.height();
+    encoded_image_.capture_time_ms_ = frame.render_time_ms();
+    encoded_image_.ntp_time_ms_ = frame.ntp_time_ms();
+    encoded_image_.rotation_ = frame.rotation();
+    encoded_image_._frameType = is_key_frame ? webrtc::VideoFrameType::kVideoFrameKey
+                                             : webrtc::VideoFrameType::kVideoFrameDelta;
+
+    auto result = callback_->OnEncodedImage(encoded_image_, &codec_specific);
+    if (result.error != webrtc::EncodedImageCallback::Result::OK) {
+        ERROR_PRINT("Failed to send the frame => %d", result.error);
+    }
+
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+void V4L2PassthroughEncoder::SetRates(const RateControlParameters &parameters) {
+    // The bitrate is decided by the camera, there is nothing to adjust here.
+}
+
+webrtc::VideoEncoder::EncoderInfo V4L2PassthroughEncoder::GetEncoderInfo() const {
+    EncoderInfo info;
+    info.supports_native_handle = true;
+    info.is_hardware_accelerated = true;
+    info.scaling_settings = VideoEncoder::ScalingSettings::kOff;
+    // Keeps WebRTC's frame dropper away, the camera's own rate control is all there is.
+    info.has_trusted_rate_controller = true;
+    info.implementation_name = "V4L2 H264 Camera Passthrough";
+    return info;
+}
@@ -0,0 +1,39 @@
+#ifndef V4L2_PASSTHROUGH_ENCODER_H_
+#define V4L2_PASSTHROUGH_ENCODER_H_
+
+#include <functional>
+
+// WebRTC
+#include <api/video_codecs/video_encoder.h>
+#include <modules/video_coding/codecs/h264/include/h264.h>
+
+/* Forwards the H.264 access units produced by the camera to WebRTC without decoding and
+ * re-encoding them. Key frame requests are handed back to the capturer, and so is every frame
+ * dropped on the way, the stream is then held back until the next IDR. */
+class V4L2PassthroughEncoder : public webrtc::VideoEncoder {
+  public:
+    using RequestKeyFrameFunc = std::function<void()>;
+
+    static std::unique_ptr<webrtc::VideoEncoder> Create(RequestKeyFrameFunc request_key_frame);
+    V4L2PassthroughEncoder(RequestKeyFrameFunc request_key_frame);
+
+    int32_t InitEncode(const webrtc::VideoCodec *codec_settings,
+                       const VideoEncoder::Settings &settings) override;
+    int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback *callback) override;
+    int32_t Release() override;
+    int32_t Encode(const webrtc::VideoFrame &frame,
+                   const std::vector<webrtc::VideoFrameType> *frame_types) override;
+    void SetRates(const RateControlParameters &parameters) override;
+    webrtc::VideoEncoder::EncoderInfo GetEncoderInfo() const override;
+
+  private:
+    bool has_first_keyframe_;
+    // The driver's sequence of the last frame seen, a gap means a P-frame went missing.
+    uint32_t last_sequence_;
+    webrtc::VideoCodec codec_;
+    webrtc::EncodedImage encoded_image_;
+    webrtc::EncodedImageCallback *callback_;
+    RequestKeyFrameFunc request_key_frame_;
+};
+
+#endif // V4L2_PASSTHROUGH_ENCODER_H_
@@ -5,22 +5,26 @@ const char *SCALER_FILE = "/dev/video12";
 const int BUFFER_NUM = 2;
 
 std::unique_ptr<V4L2Scaler> V4L2Scaler::Create(int src_width, int src_height, int dst_width,
-                                               int dst_height, bool is_dma_src, bool is_dma_dst) {
+                                               int dst_height, bool is_dma_src, bool is_dma_dst,
+                                               uint32_t src_pix_fmt, int src_stride) {
     auto scaler = std::make_unique<V4L2Scaler>();
-    scaler->Configure(src_width, src_height, dst_width, dst_height, is_dma_src, is_dma_dst);
+    scaler->Configure(src_width, src_height, dst_width, dst_height, is_dma_src, is_dma_dst,
+                      src_pix_fmt, src_stride);
     scaler->Start();
     return scaler;
 }
 
 bool V4L2Scaler::Configure(int src_width, int src_height, int dst_width, int dst_height,
-                           bool is_dma_src, bool is_dma_dst) {
+                           bool is_dma_src, bool is_dma_dst, uint32_t src_pix_fmt,
+                           int src_stride) {
     if (!Open(SCALER_FILE)) {
         DEBUG_PRINT("Failed to turn on scaler: %s", SCALER_FILE);
         return false;
     }
     auto src_memory = is_dma_src ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
-    PrepareBuffer(&output_, src_width, src_height, V4L2_PIX_FMT_YUV420,
-                  V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, src_memory, BUFFER_NUM);
+    // The ISP converts packed and semi-planar input to I420 on the way.
+    PrepareBuffer(&output_, src_width, src_height, src_pix_fmt, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE,
+                  src_memory, BUFFER_NUM, false, src_stride);
     PrepareBuffer(&capture_, dst_width, dst_height, V4L2_PIX_FMT_YUV420,
                   V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, V4L2_MEMORY_MMAP, BUFFER_NUM, is_dma_dst);
 
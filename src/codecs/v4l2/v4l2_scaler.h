@@ -6,11 +6,13 @@
 class V4L2Scaler : public V4L2Codec {
   public:
     static std::unique_ptr<V4L2Scaler> Create(int src_width, int src_height, int dst_width,
-                                              int dst_height, bool is_dma_src, bool is_dma_dst);
+                                              int dst_height, bool is_dma_src, bool is_dma_dst,
+                                              uint32_t src_pix_fmt = V4L2_PIX_FMT_YUV420,
+                                              int src_stride = 0);
 
   private:
     bool Configure(int src_width, int src_height, int dst_width, int dst_height, bool is_drm_src,
-                   bool is_drm_dst);
+                   bool is_drm_dst, uint32_t src_pix_fmt, int src_stride);
 };
 
 #endif // V4L2_SCALER_H_
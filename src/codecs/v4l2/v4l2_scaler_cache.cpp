@@ -0,0 +1,68 @@
+#include "codecs/v4l2/v4l2_scaler_cache.h"
+#include "common/logging.h"
+
+#include <algorithm>
+
+V4L2ScalerCache::V4L2ScalerCache(int src_width, int src_height, bool is_dma_src,
+                                 bool is_dma_dst, size_t capacity)
+    : src_width_(src_width),
+      src_height_(src_height),
+      is_dma_src_(is_dma_src),
+      is_dma_dst_(is_dma_dst),
+      capacity_(std::max(capacity, (size_t)1)),
+      src_pix_fmt_(0),
+      src_stride_(0) {}
+
+void V4L2ScalerCache::Reset(uint32_t src_pix_fmt, int src_stride) {
+    if (src_pix_fmt == src_pix_fmt_ && src_stride == src_stride_) {
+        return;
+    }
+    entries_.clear();
+    src_pix_fmt_ = src_pix_fmt;
+    src_stride_ = src_stride;
+}
+
+V4L2Scaler *V4L2ScalerCache::Get(int dst_width, int dst_height, uint32_t src_pix_fmt,
+                                 int src_stride) {
+    Reset(src_pix_fmt, src_stride);
+
+    for (auto it = entries_.begin(); it != entries_.end(); it++) {
+        if (it->dst_width == dst_width && it->dst_height == dst_height) {
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front().scaler.get();
+        }
+    }
+
+    if (entries_.size() >= capacity_) {
+        DEBUG_PRINT("Closing the %dx%d scaler", entries_.back().dst_width,
+                    entries_.back().dst_height);
+        entries_.pop_back();
+    }
+    DEBUG_PRINT("Opening a %dx%d -> %dx%d scaler", src_width_, src_height_, dst_width,
+                dst_height);
+    entries_.push_front({dst_width, dst_height,
+                         V4L2Scaler::Create(src_width_, src_height_, dst_width, dst_height,
+                                            is_dma_src_, is_dma_dst_, src_pix_fmt, src_stride)});
+    return entries_.front().scaler.get();
+}
+
+void V4L2ScalerCache::Prewarm(const std::vector<std::pair<int, int>> &dst_sizes,
+                              uint32_t src_pix_fmt, int src_stride) {
+    Reset(src_pix_fmt, src_stride);
+
+    for (auto &[dst_width, dst_height] : dst_sizes) {
+        if (entries_.size() >= capacity_) {
+            return;
+        }
+        bool is_cached = false;
+        for (auto &entry : entries_) {
+            is_cached |= entry.dst_width == dst_width && entry.dst_height == dst_height;
+        }
+        if (!is_cached) {
+            entries_.push_back({dst_width, dst_height,
+                                V4L2Scaler::Create(src_width_, src_height_, dst_width,
+                                                   dst_height, is_dma_src_, is_dma_dst_,
+                                                   src_pix_fmt, src_stride)});
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#ifndef V4L2_SCALER_CACHE_H_
+#define V4L2_SCALER_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <vector>
+
+#include "codecs/v4l2/v4l2_scaler.h"
+
+/* Keeps a configured scaler per output size, so switching between sizes, e.g. while the
+ * bandwidth estimate oscillates, takes a frame instead of reopening the device and restarting
+ * streaming. The least recently used scaler is closed once more than `capacity` are open. */
+class V4L2ScalerCache {
+  public:
+    V4L2ScalerCache(int src_width, int src_height, bool is_dma_src, bool is_dma_dst,
+                    size_t capacity);
+
+    // Every cached scaler is dropped when the source format or stride differs from before.
+    V4L2Scaler *Get(int dst_width, int dst_height, uint32_t src_pix_fmt, int src_stride);
+    // Opens scalers for the sizes likely to be picked next, the least recently used at first.
+    void Prewarm(const std::vector<std::pair<int, int>> &dst_sizes, uint32_t src_pix_fmt,
+                 int src_stride);
+
+  private:
+    struct Entry {
+        int dst_width;
+        int dst_height;
+        std::unique_ptr<V4L2Scaler> scaler;
+    };
+
+    int src_width_;
+    int src_height_;
+    bool is_dma_src_;
+    bool is_dma_dst_;
+    size_t capacity_;
+    uint32_t src_pix_fmt_;
+    int src_stride_;
+    // Most recently used first.
+    std::list<Entry> entries_;
+
+    void Reset(uint32_t src_pix_fmt, int src_stride);
+};
+
+#endif // V4L2_SCALER_CACHE_H_
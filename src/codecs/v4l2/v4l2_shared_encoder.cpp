@@ -0,0 +1,128 @@
+#include "codecs/v4l2/v4l2_shared_encoder.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <tuple>
+
+std::shared_ptr<V4L2SharedEncoder> V4L2SharedEncoder::Acquire(int width, int height,
+                                                              bool is_dma_src,
+                                                              uint32_t src_pix_fmt,
+                                                              int src_stride) {
+    static std::mutex registry_mutex;
+    static std::map<std::tuple<int, int, bool, uint32_t, int>, std::weak_ptr<V4L2SharedEncoder>>
+        registry;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto key = std::make_tuple(width, height, is_dma_src, src_pix_fmt, src_stride);
+    auto shared = registry[key].lock();
+    if (!shared) {
+        shared = std::make_shared<V4L2SharedEncoder>(width, height, is_dma_src, src_pix_fmt,
+                                                     src_stride);
+        registry[key] = shared;
+        DEBUG_PRINT("Create shared encoder tier %dx%d", width, height);
+    }
+    return shared;
+}
+
+V4L2SharedEncoder::V4L2SharedEncoder(int width, int height, bool is_dma_src,
+                                     uint32_t src_pix_fmt, int src_stride)
+    : width_(width),
+      height_(height),
+      next_id_(0),
+      last_timestamp_us_(-1),
+      is_key_frame_pending_(false),
+      is_key_frame_in_flight_(false),
+      forced_timestamp_us_(-1),
+      encoder_(V4L2Encoder::Create(width, height, is_dma_src, src_pix_fmt, src_stride)) {}
+
+V4L2SharedEncoder::~V4L2SharedEncoder() {
+    encoder_.reset();
+    DEBUG_PRINT("Shared encoder tier %dx%d was released!", width_, height_);
+}
+
+int V4L2SharedEncoder::Subscribe(OnEncodedFunc func) {
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(encode_mutex_);
+        id = next_id_++;
+        // a new viewer always needs an IDR to start decoding.
+        is_key_frame_pending_ = true;
+    }
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    subscribers_[id] = std::move(func);
+    return id;
+}
+
+void V4L2SharedEncoder::UnSubscribe(int id) {
+    {
+        std::lock_guard<std::mutex> lock(subscribers_mutex_);
+        subscribers_.erase(id);
+    }
+    std::lock_guard<std::mutex> lock(encode_mutex_);
+    rates_.erase(id);
+    ApplyRates();
+}
+
+void V4L2SharedEncoder::SetRates(int id, uint32_t bitrate_bps, int fps) {
+    std::lock_guard<std::mutex> lock(encode_mutex_);
+    rates_[id] = {bitrate_bps, fps};
+    ApplyRates();
+}
+
+void V4L2SharedEncoder::ApplyRates() {
+    if (rates_.empty()) {
+        return;
+    }
+
+    // Follow the viewer with the weakest link so nobody is flooded, and the fastest frame rate
+    // so nobody is starved.
+    uint32_t bitrate_bps = UINT32_MAX;
+    int fps = 0;
+    for (auto &[id, rates] : rates_) {
+        bitrate_bps = std::min(bitrate_bps, rates.bitrate_bps);
+        fps = std::max(fps, rates.fps);
+    }
+
+    encoder_->SetFps(fps);
+    encoder_->SetBitrate(bitrate_bps);
+}
+
+void V4L2SharedEncoder::Encode(const webrtc::VideoFrame &frame, V4L2Buffer &src_buffer,
+                               bool is_key_frame) {
+    std::lock_guard<std::mutex> lock(encode_mutex_);
+
+    if (is_key_frame) {
+        is_key_frame_pending_ = true;
+    }
+    if (frame.timestamp_us() <= last_timestamp_us_) {
+        // Another peer already submitted this frame, its output is broadcast to everyone.
+        return;
+    }
+    last_timestamp_us_ = frame.timestamp_us();
+
+    if (is_key_frame_pending_ && !is_key_frame_in_flight_) {
+        V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
+        forced_timestamp_us_ = frame.timestamp_us();
+        is_key_frame_in_flight_ = true;
+    }
+
+    encoder_->EmplaceBuffer(src_buffer, [this, frame](V4L2Buffer &encoded_buffer) {
+        Broadcast(frame, encoded_buffer);
+    });
+}
+
+void V4L2SharedEncoder::Broadcast(const webrtc::VideoFrame &frame, V4L2Buffer &encoded_buffer) {
+    if (encoded_buffer.flags & V4L2_BUF_FLAG_KEYFRAME) {
+        is_key_frame_pending_ = false;
+    }
+    if (frame.timestamp_us() >= forced_timestamp_us_) {
+        // The forced frame is out, if the driver did not make it a key frame the request is
+        // still pending and the next frame forces another one.
+        is_key_frame_in_flight_ = false;
+    }
+
+    std::lock_guard<std::mutex> lock(subscribers_mutex_);
+    for (auto &[id, on_encoded] : subscribers_) {
+        on_encoded(frame, encoded_buffer);
+    }
+}
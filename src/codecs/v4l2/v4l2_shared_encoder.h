@@ -0,0 +1,63 @@
+#ifndef V4L2_SHARED_ENCODER_H_
+#define V4L2_SHARED_ENCODER_H_
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <api/video/video_frame.h>
+
+#include "codecs/v4l2/v4l2_encoder.h"
+
+/* One hardware encoding session per resolution tier. Every peer's `V4L2H264Encoder` subscribes
+ * to the same instance, a frame is encoded only once and the output is broadcast to all
+ * subscribers. Key frame requests arriving from several peers are coalesced.
+ *
+ * Every subscriber gets every encoded frame, even one its own WebRTC encoder skipped: they all
+ * share one reference chain, and withholding a delta frame from a peer would break its decoding
+ * until the next IDR. Per peer rates only steer the shared bitrate and frame rate. */
+class V4L2SharedEncoder {
+  public:
+    using OnEncodedFunc =
+        std::function<void(const webrtc::VideoFrame &frame, V4L2Buffer &encoded_buffer)>;
+
+    static std::shared_ptr<V4L2SharedEncoder> Acquire(int width, int height, bool is_dma_src,
+                                                      uint32_t src_pix_fmt = V4L2_PIX_FMT_YUV420,
+                                                      int src_stride = 0);
+
+    V4L2SharedEncoder(int width, int height, bool is_dma_src, uint32_t src_pix_fmt,
+                      int src_stride);
+    ~V4L2SharedEncoder();
+
+    int Subscribe(OnEncodedFunc func);
+    void UnSubscribe(int id);
+    void SetRates(int id, uint32_t bitrate_bps, int fps);
+    void Encode(const webrtc::VideoFrame &frame, V4L2Buffer &src_buffer, bool is_key_frame);
+
+  private:
+    struct Rates {
+        uint32_t bitrate_bps;
+        int fps;
+    };
+
+    int width_;
+    int height_;
+    int next_id_;
+    int64_t last_timestamp_us_;
+    // Set until a key frame actually leaves the encoder.
+    std::atomic<bool> is_key_frame_pending_;
+    // A key frame was forced on the frame at `forced_timestamp_us_` and it is not out yet.
+    std::atomic<bool> is_key_frame_in_flight_;
+    std::atomic<int64_t> forced_timestamp_us_;
+    std::mutex encode_mutex_;
+    std::mutex subscribers_mutex_;
+    std::map<int, OnEncodedFunc> subscribers_;
+    std::map<int, Rates> rates_;
+    std::unique_ptr<V4L2Encoder> encoder_;
+
+    void ApplyRates();
+    void Broadcast(const webrtc::VideoFrame &frame, V4L2Buffer &encoded_buffer);
+};
+
+#endif // V4L2_SHARED_ENCODER_H_
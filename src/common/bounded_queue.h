@@ -0,0 +1,238 @@
+#ifndef BOUNDED_QUEUE_H_
+#define BOUNDED_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+struct QueueStats {
+    uint64_t pushed;
+    uint64_t popped;
+    uint64_t dropped;
+    size_t high_water_mark;
+};
+
+/* A bounded multi-producer queue. Items are moved in and out, consumers can block on
+ * `wait_pop` until an item arrives, the timeout expires or the queue is shut down. */
+template <typename T> class BoundedQueue {
+  public:
+    enum class Overflow {
+        Reject,     // `push` fails when full
+        DropOldest, // the oldest item makes room for the new one
+    };
+
+    explicit BoundedQueue(size_t capacity, Overflow overflow = Overflow::Reject)
+        : capacity_(std::max<size_t>(capacity, 1)),
+          overflow_(overflow),
+          shutdown_(false),
+          stats_({}) {}
+
+    bool push(T item) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (shutdown_) {
+                return false;
+            }
+            if (queue_.size() >= capacity_) {
+                stats_.dropped++;
+                if (overflow_ == Overflow::Reject) {
+                    return false;
+                }
+                queue_.pop_front();
+            }
+            queue_.push_back(std::move(item));
+            stats_.pushed++;
+            stats_.high_water_mark = std::max(stats_.high_water_mark, queue_.size());
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    std::optional<T> try_pop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return PopLocked();
+    }
+
+    // Returns nullopt on timeout, or right away once the queue is shut down and drained.
+    std::optional<T> wait_pop(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait_for(lock, timeout, [this]() {
+            return !queue_.empty() || shutdown_;
+        });
+        return PopLocked();
+    }
+
+    std::optional<T> front() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue_.empty()) {
+            return std::nullopt;
+        }
+        return queue_.front();
+    }
+
+    // Wakes up every waiting consumer, further pushes are rejected.
+    void shutdown() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            shutdown_ = true;
+        }
+        cond_.notify_all();
+    }
+
+    // Drops every item and accepts pushes again.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+        shutdown_ = false;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    QueueStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+  private:
+    const size_t capacity_;
+    const Overflow overflow_;
+    bool shutdown_;
+    QueueStats stats_;
+    std::deque<T> queue_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+
+    std::optional<T> PopLocked() {
+        if (queue_.empty()) {
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(queue_.front()));
+        queue_.pop_front();
+        stats_.popped++;
+        return item;
+    }
+};
+
+/* Lock-free ring for exactly one producer thread and one consumer thread. Pushing never blocks
+ * and fails when full. A consumer that runs dry may sleep in `wait_pop`, only then does the
+ * producer take a lock to wake it up. */
+template <typename T> class SpscQueue {
+  public:
+    explicit SpscQueue(size_t capacity)
+        : slots_(capacity + 1),
+          head_(0),
+          tail_(0),
+          waiting_(false),
+          pushed_(0),
+          popped_(0),
+          dropped_(0),
+          high_water_mark_(0) {}
+
+    bool push(T item) {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        const size_t next = Next(head);
+        if (next == tail_.load(std::memory_order_acquire)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head] = std::move(item);
+        head_.store(next, std::memory_order_release);
+        pushed_.fetch_add(1, std::memory_order_relaxed);
+
+        size_t size = Size(next, tail_.load(std::memory_order_relaxed));
+        if (size > high_water_mark_.load(std::memory_order_relaxed)) {
+            high_water_mark_.store(size, std::memory_order_relaxed);
+        }
+
+        // Pairs with the consumer raising `waiting_` before it re-checks the ring.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cond_.notify_one();
+        }
+        return true;
+    }
+
+    std::optional<T> try_pop() {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(slots_[tail]));
+        slots_[tail] = T();
+        tail_.store(Next(tail), std::memory_order_release);
+        popped_.fetch_add(1, std::memory_order_relaxed);
+        return item;
+    }
+
+    std::optional<T> wait_pop(std::chrono::milliseconds timeout) {
+        if (auto item = try_pop()) {
+            return item;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiting_.store(true, std::memory_order_seq_cst);
+        cond_.wait_for(lock, timeout, [this]() {
+            return tail_.load(std::memory_order_relaxed) != head_.load(std::memory_order_acquire);
+        });
+        waiting_.store(false, std::memory_order_relaxed);
+        lock.unlock();
+        return try_pop();
+    }
+
+    // Only meaningful on the consumer thread.
+    const T *front() const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &slots_[tail];
+    }
+
+    // Only meaningful on the consumer thread.
+    void clear() {
+        while (try_pop()) {
+        }
+    }
+
+    size_t size() const {
+        return Size(head_.load(std::memory_order_acquire), tail_.load(std::memory_order_acquire));
+    }
+
+    size_t capacity() const { return slots_.size() - 1; }
+
+    QueueStats stats() const {
+        return {pushed_.load(std::memory_order_relaxed), popped_.load(std::memory_order_relaxed),
+                dropped_.load(std::memory_order_relaxed),
+                high_water_mark_.load(std::memory_order_relaxed)};
+    }
+
+  private:
+    std::vector<T> slots_;
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+    std::atomic<bool> waiting_;
+    std::atomic<uint64_t> pushed_;
+    std::atomic<uint64_t> popped_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<size_t> high_water_mark_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+
+    size_t Next(size_t index) const { return (index + 1) % slots_.size(); }
+    size_t Size(size_t head, size_t tail) const {
+        return (head + slots_.size() - tail) % slots_.size();
+    }
+};
+
+#endif // BOUNDED_QUEUE_H_
@@ -0,0 +1,92 @@
+#ifndef BUFFER_LEASE_H_
+#define BUFFER_LEASE_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+class BufferLeasePool;
+
+/* Keeps one dequeued driver buffer away from the driver. The buffer is handed back to its pool,
+ * i.e. re-queued, once the last reference to the lease is dropped. */
+class BufferLease {
+  public:
+    BufferLease(std::shared_ptr<BufferLeasePool> pool, int index);
+    ~BufferLease();
+    int index() const { return index_; }
+
+  private:
+    std::shared_ptr<BufferLeasePool> pool_;
+    int index_;
+};
+
+class BufferLeasePool : public std::enable_shared_from_this<BufferLeasePool> {
+  public:
+    using ReleaseFunc = std::function<void(int index)>;
+    using DrainedFunc = std::function<void()>;
+
+    static std::shared_ptr<BufferLeasePool> Create(int num_buffers, ReleaseFunc release) {
+        return std::make_shared<BufferLeasePool>(num_buffers, std::move(release));
+    }
+
+    BufferLeasePool(int num_buffers, ReleaseFunc release)
+        : num_buffers_(num_buffers),
+          leased_(0),
+          closed_(false),
+          release_(std::move(release)) {}
+
+    std::shared_ptr<BufferLease> Acquire(int index) {
+        leased_++;
+        return std::make_shared<BufferLease>(shared_from_this(), index);
+    }
+
+    int num_buffers() const { return num_buffers_; }
+    int leased() const { return leased_.load(); }
+    // Whether leasing one more buffer would leave too few with the driver, which then stalls.
+    // The caller hands the buffer straight back instead, dropping the frame.
+    bool is_exhausted() const { return num_buffers_ - leased_.load() - 1 < kMinQueuedBuffers; }
+
+    /* Leases released after closing are dropped instead of handed back to the driver.
+     * `on_drained` runs once no lease is left, right away or on the last release, e.g. to unmap
+     * the buffers only when no frame points into them anymore. */
+    void Close(DrainedFunc on_drained = nullptr) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        on_drained_ = std::move(on_drained);
+        if (leased_ == 0 && on_drained_) {
+            std::exchange(on_drained_, nullptr)();
+        }
+    }
+
+  private:
+    friend class BufferLease;
+
+    static const int kMinQueuedBuffers = 1;
+
+    int num_buffers_;
+    std::atomic<int> leased_;
+    bool closed_;
+    std::mutex mutex_;
+    ReleaseFunc release_;
+    DrainedFunc on_drained_;
+
+    void Release(int index) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        leased_--;
+        if (!closed_ && release_) {
+            release_(index);
+        } else if (closed_ && leased_ == 0 && on_drained_) {
+            std::exchange(on_drained_, nullptr)();
+        }
+    }
+};
+
+inline BufferLease::BufferLease(std::shared_ptr<BufferLeasePool> pool, int index)
+    : pool_(std::move(pool)),
+      index_(index) {}
+
+inline BufferLease::~BufferLease() { pool_->Release(index_); }
+
+#endif // BUFFER_LEASE_H_
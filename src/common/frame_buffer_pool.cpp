@@ -0,0 +1,97 @@
+#include "common/frame_buffer_pool.h"
+#include "common/logging.h"
+
+#include <rtc_base/memory/aligned_malloc.h>
+
+// Aligning pointer to 64 bytes for improved performance, e.g. use SIMD.
+static const int kBufferAlignment = 64;
+static const size_t kMinSizeClass = 4096;
+// About two minutes of frames at 30 fps.
+static const uint64_t kStatsInterval = 3600;
+
+void PooledBlockDeleter::operator()(uint8_t *data) const {
+    if (auto shared = pool.lock()) {
+        shared->Release(data, size_class);
+    } else {
+        webrtc::AlignedFree(data);
+    }
+}
+
+std::shared_ptr<FrameBufferPool> FrameBufferPool::Create(int max_free_blocks_per_class) {
+    return std::make_shared<FrameBufferPool>(max_free_blocks_per_class);
+}
+
+FrameBufferPool::FrameBufferPool(int max_free_blocks_per_class)
+    : max_free_blocks_per_class_(max_free_blocks_per_class),
+      stats_({}) {}
+
+FrameBufferPool::~FrameBufferPool() {
+    LogStats();
+    for (auto &[size_class, blocks] : free_blocks_) {
+        for (auto *block : blocks) {
+            webrtc::AlignedFree(block);
+        }
+    }
+}
+
+size_t FrameBufferPool::SizeClass(size_t size) {
+    if (size <= kMinSizeClass) {
+        return kMinSizeClass;
+    }
+
+    size_t power = kMinSizeClass;
+    while (power * 2 <= size) {
+        power *= 2;
+    }
+    size_t step = power / 4;
+    return (size + step - 1) / step * step;
+}
+
+PooledBlock FrameBufferPool::Acquire(size_t size) {
+    const size_t size_class = SizeClass(size);
+    PooledBlockDeleter deleter{weak_from_this(), size_class};
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto &blocks = free_blocks_[size_class];
+        if (!blocks.empty()) {
+            uint8_t *block = blocks.back();
+            blocks.pop_back();
+            stats_.hits++;
+            stats_.pooled_bytes -= size_class;
+            if ((stats_.hits + stats_.misses) % kStatsInterval == 0) {
+                LogStats();
+            }
+            return PooledBlock(block, deleter);
+        }
+        stats_.misses++;
+        if ((stats_.hits + stats_.misses) % kStatsInterval == 0) {
+            LogStats();
+        }
+    }
+
+    auto *block = static_cast<uint8_t *>(webrtc::AlignedMalloc(size_class, kBufferAlignment));
+    return PooledBlock(block, deleter);
+}
+
+void FrameBufferPool::Release(uint8_t *data, size_t size_class) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &blocks = free_blocks_[size_class];
+    if ((int)blocks.size() >= max_free_blocks_per_class_) {
+        webrtc::AlignedFree(data);
+        return;
+    }
+    blocks.push_back(data);
+    stats_.pooled_bytes += size_class;
+}
+
+FrameBufferPool::Stats FrameBufferPool::GetStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void FrameBufferPool::LogStats() const {
+    DEBUG_PRINT("Frame buffer pool hits: %llu, misses: %llu, pooled: %zu bytes",
+                (unsigned long long)stats_.hits, (unsigned long long)stats_.misses,
+                stats_.pooled_bytes);
+}
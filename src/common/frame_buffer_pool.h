@@ -0,0 +1,53 @@
+#ifndef FRAME_BUFFER_POOL_H_
+#define FRAME_BUFFER_POOL_H_
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class FrameBufferPool;
+
+/* Hands a pooled block back to its pool, or frees it when the pool is already gone. */
+struct PooledBlockDeleter {
+    std::weak_ptr<FrameBufferPool> pool;
+    size_t size_class = 0;
+    void operator()(uint8_t *data) const;
+};
+
+using PooledBlock = std::unique_ptr<uint8_t, PooledBlockDeleter>;
+
+/* Recycles the 64-byte aligned blocks frame buffers copy their data into. Requests are rounded
+ * up to size classes four steps per power of two apart, so compressed frames of slightly
+ * different sizes still share blocks while at most a quarter of a block goes unused. The hit
+ * rate is also logged every few thousand requests. */
+class FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool> {
+  public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t pooled_bytes;
+    };
+
+    static std::shared_ptr<FrameBufferPool> Create(int max_free_blocks_per_class = 4);
+
+    FrameBufferPool(int max_free_blocks_per_class);
+    ~FrameBufferPool();
+
+    PooledBlock Acquire(size_t size);
+    Stats GetStats() const;
+
+  private:
+    friend struct PooledBlockDeleter;
+
+    const int max_free_blocks_per_class_;
+    mutable std::mutex mutex_;
+    std::map<size_t, std::vector<uint8_t *>> free_blocks_;
+    Stats stats_;
+
+    static size_t SizeClass(size_t size);
+    void Release(uint8_t *data, size_t size_class);
+    void LogStats() const;
+};
+
+#endif // FRAME_BUFFER_POOL_H_
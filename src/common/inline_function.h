@@ -0,0 +1,101 @@
+#ifndef INLINE_FUNCTION_H_
+#define INLINE_FUNCTION_H_
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template <typename Signature, size_t Capacity> class InlineFunction;
+
+/* A move-only `std::function` that never allocates, the callable is stored in place. Callables
+ * larger than `Capacity` do not compile, so a hot path cannot silently fall back to the heap. */
+template <typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity> {
+  public:
+    InlineFunction()
+        : ops_(nullptr) {}
+    InlineFunction(std::nullptr_t)
+        : ops_(nullptr) {}
+
+    template <typename F, typename = std::enable_if_t<
+                              !std::is_same_v<std::decay_t<F>, InlineFunction> &&
+                              std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>>
+    InlineFunction(F &&f)
+        : ops_(nullptr) {
+        using Callable = std::decay_t<F>;
+        static_assert(sizeof(Callable) <= Capacity, "The callable does not fit, raise Capacity.");
+        static_assert(alignof(Callable) <= alignof(std::max_align_t), "Over-aligned callable.");
+        new (&storage_) Callable(std::forward<F>(f));
+        ops_ = &kOps<Callable>;
+    }
+
+    InlineFunction(InlineFunction &&other) noexcept
+        : ops_(nullptr) {
+        MoveFrom(other);
+    }
+
+    InlineFunction &operator=(InlineFunction &&other) noexcept {
+        if (this != &other) {
+            Reset();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    InlineFunction &operator=(std::nullptr_t) {
+        Reset();
+        return *this;
+    }
+
+    InlineFunction(const InlineFunction &) = delete;
+    InlineFunction &operator=(const InlineFunction &) = delete;
+
+    ~InlineFunction() { Reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+
+    R operator()(Args... args) { return ops_->invoke(&storage_, std::forward<Args>(args)...); }
+
+  private:
+    struct Ops {
+        R (*invoke)(void *callable, Args &&...args);
+        // Move-constructs into `dst` and destroys `src`.
+        void (*move)(void *dst, void *src);
+        void (*destroy)(void *callable);
+    };
+
+    template <typename Callable>
+    static constexpr Ops kOps = {
+        [](void *callable, Args &&...args) -> R {
+            return (*static_cast<Callable *>(callable))(std::forward<Args>(args)...);
+        },
+        [](void *dst, void *src) {
+            new (dst) Callable(std::move(*static_cast<Callable *>(src)));
+            static_cast<Callable *>(src)->~Callable();
+        },
+        [](void *callable) {
+            static_cast<Callable *>(callable)->~Callable();
+        },
+    };
+
+    const Ops *ops_;
+    alignas(std::max_align_t) unsigned char storage_[Capacity];
+
+    void MoveFrom(InlineFunction &other) {
+        if (other.ops_) {
+            other.ops_->move(&storage_, &other.storage_);
+            ops_ = other.ops_;
+            other.ops_ = nullptr;
+        }
+    }
+
+    void Reset() {
+        if (ops_) {
+            ops_->destroy(&storage_);
+            ops_ = nullptr;
+        }
+    }
+};
+
+#endif // INLINE_FUNCTION_H_
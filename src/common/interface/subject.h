@@ -2,56 +2,183 @@
 #define SUBJECT_H_
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
 
+#include "common/bounded_queue.h"
+#include "common/logging.h"
+#include "common/worker.h"
+
 template <typename T> class Observable {
   public:
-    Observable() = default;
-    ~Observable() = default;
     using OnMessageFunc = std::function<void(T)>;
 
-    void Subscribe(OnMessageFunc func) { subscribed_func_ = func; }
-    void UnSubscribe() { subscribed_func_ = nullptr; }
+    Observable() = default;
+    ~Observable() { UnSubscribe(); }
+
+    // Runs `func` on the publisher's thread.
+    void Subscribe(OnMessageFunc func) {
+        UnSubscribe();
+        std::lock_guard<std::recursive_mutex> lock(func_mutex_);
+        subscribed_ = func != nullptr;
+        subscribed_func_ = func ? std::make_shared<OnMessageFunc>(std::move(func)) : nullptr;
+    }
+
+    /* Runs `func` on a thread of its own. At most `queue_depth` messages wait for it, the oldest
+     * one is dropped when a slow subscriber falls behind, so the publisher never waits. */
+    void Subscribe(OnMessageFunc func, size_t queue_depth) {
+        Subscribe(std::move(func));
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        queue_ = std::make_unique<BoundedQueue<Pending>>(
+            queue_depth, BoundedQueue<Pending>::Overflow::DropOldest);
+        worker_ = std::make_unique<Worker>("Observer", [this]() {
+            Deliver();
+        });
+        worker_->Run();
+    }
+
+    /* Once it returns, the subscribed function is neither running nor going to run again, unless
+     * it is called from that function. Its worker then exits once the call returns, and is joined
+     * by the next (un)subscription. */
+    void UnSubscribe() {
+        std::unique_ptr<Worker> workers[2];
+        std::unique_ptr<BoundedQueue<Pending>> queue;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            workers[0] = std::move(worker_);
+            workers[1] = std::move(retired_worker_);
+            queue = std::move(queue_);
+        }
+        if (queue) {
+            queue->shutdown();
+            auto stats = queue->stats();
+            DEBUG_PRINT("Observer delivered %llu, dropped %llu, max lag %lld us",
+                        (unsigned long long)stats.popped, (unsigned long long)stats.dropped,
+                        (long long)max_lag_us_.load());
+        }
+        for (auto &worker : workers) {
+            if (worker && worker->IsCurrent()) {
+                worker->Stop();
+                std::lock_guard<std::mutex> lock(queue_mutex_);
+                retired_worker_ = std::move(worker);
+            }
+            worker.reset();
+        }
+
+        std::lock_guard<std::recursive_mutex> lock(func_mutex_);
+        subscribed_ = false;
+        subscribed_func_ = nullptr;
+    }
+
+    // Lock free, so publishers can check it per message to skip work nobody would receive.
+    bool is_subscribed() const { return subscribed_.load(); }
+
+    void Emit(T message) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (queue_) {
+                queue_->push({std::chrono::steady_clock::now(), std::move(message)});
+                return;
+            }
+        }
+        Invoke(std::move(message));
+    }
+
+  private:
+    struct Pending {
+        std::chrono::steady_clock::time_point queued_at;
+        T message;
+    };
 
-    OnMessageFunc subscribed_func_;
+    std::recursive_mutex func_mutex_;
+    // Shared, so a function that unsubscribes itself lives until it returns.
+    std::shared_ptr<OnMessageFunc> subscribed_func_;
+    std::atomic<bool> subscribed_ = false;
+
+    std::mutex queue_mutex_;
+    std::unique_ptr<BoundedQueue<Pending>> queue_;
+    std::unique_ptr<Worker> worker_;
+    std::unique_ptr<Worker> retired_worker_;
+    std::atomic<int64_t> max_lag_us_ = 0; // longest time a message waited in the queue
+
+    void Invoke(T message) {
+        std::lock_guard<std::recursive_mutex> lock(func_mutex_);
+        if (auto func = subscribed_func_) {
+            (*func)(std::move(message));
+        }
+    }
+
+    void Deliver() {
+        BoundedQueue<Pending> *queue;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            queue = queue_.get();
+        }
+        if (!queue) {
+            return;
+        }
+
+        auto pending = queue->wait_pop(std::chrono::milliseconds(100));
+        if (!pending) {
+            return;
+        }
+
+        int64_t lag_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - pending->queued_at)
+                             .count();
+        if (lag_us > max_lag_us_.load()) {
+            max_lag_us_.store(lag_us);
+        }
+
+        Invoke(std::move(pending->message));
+    }
 };
 
 template <typename T> class Subject {
   public:
     virtual ~Subject() = default;
     virtual void Next(T message) {
-        for (auto &observer : observers_) {
-            if (observer && observer->subscribed_func_ != nullptr) {
-                observer->subscribed_func_(message);
-            }
+        // Observers are copied on write, publishing never holds the lock while delivering.
+        auto observers = Snapshot();
+        for (auto &observer : *observers) {
+            observer->Emit(message);
         }
     }
 
     virtual std::shared_ptr<Observable<T>> AsObservable() {
         auto observer = std::make_shared<Observable<T>>();
-        observers_.push_back(observer);
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto observers = std::make_shared<ObserverList>(*observers_);
+        observers->push_back(observer);
+        observers_ = observers;
         return observer;
     }
 
     virtual void UnSubscribe() {
-        auto it = observers_.begin();
-        while (it != observers_.end()) {
-            it->reset();
-            it = observers_.erase(it);
-        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        observers_ = std::make_shared<ObserverList>();
+    }
+
+    bool HasSubscribers() {
+        auto observers = Snapshot();
+        return std::any_of(observers->begin(), observers->end(), [](const auto &observer) {
+            return observer->is_subscribed();
+        });
     }
 
   protected:
-    std::vector<std::shared_ptr<Observable<T>>> observers_;
-
-    void RemoveNullObservers() {
-        auto new_end = std::remove_if(observers_.begin(), observers_.end(),
-                                      [](const std::shared_ptr<Observable<T>> observer) {
-                                          return !observer;
-                                      });
-        observers_.erase(new_end, observers_.end());
+    using ObserverList = std::vector<std::shared_ptr<Observable<T>>>;
+
+    std::mutex mutex_;
+    std::shared_ptr<const ObserverList> observers_ = std::make_shared<ObserverList>();
+
+    std::shared_ptr<const ObserverList> Snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return observers_;
     }
 };
 
@@ -0,0 +1,91 @@
+#include "common/latest_frame_store.h"
+
+// A converted frame younger than this is served without waiting for the next capture.
+static const std::chrono::milliseconds kFreshFrameAge(100);
+
+LatestFrameStore::LatestFrameStore()
+    : demand_(false),
+      waiters_(0),
+      converting_(0),
+      sequence_(0),
+      converted_sequence_(0) {}
+
+bool LatestFrameStore::has_demand() const { return demand_.load(std::memory_order_relaxed); }
+
+void LatestFrameStore::Publish(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+    if (!demand_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    if (!frame_buffer->has_lease()) {
+        // The driver refills this memory as soon as the capture callback returns.
+        frame_buffer->CopyBufferData();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        frame_buffer_ = frame_buffer;
+        sequence_++;
+        demand_.store(false, std::memory_order_release);
+    }
+    cond_.notify_all();
+}
+
+rtc::scoped_refptr<webrtc::I420BufferInterface>
+LatestFrameStore::GetI420Frame(std::chrono::milliseconds timeout, uint64_t *sequence) {
+    uint64_t unused_sequence;
+    if (!sequence) {
+        sequence = &unused_sequence;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    *sequence = converted_sequence_;
+    if (i420_buffer_ && std::chrono::steady_clock::now() - converted_time_ < kFreshFrameAge) {
+        return i420_buffer_;
+    }
+
+    const uint64_t seen = sequence_;
+    demand_.store(true, std::memory_order_release);
+
+    waiters_++;
+    bool is_fresh = cond_.wait_for(lock, timeout, [this, seen]() {
+        return sequence_ != seen;
+    });
+    if (--waiters_ == 0 && !is_fresh) {
+        // Nobody is left to pick up the next frame, do not let the capture thread park one.
+        demand_.store(false, std::memory_order_release);
+    }
+    if (!is_fresh) {
+        return i420_buffer_;
+    }
+
+    if (converted_sequence_ == sequence_ || !frame_buffer_) {
+        // Readers woken by the same frame share the first one's conversion.
+        cond_.wait(lock, [this]() {
+            return converting_ == 0;
+        });
+        *sequence = converted_sequence_;
+        return i420_buffer_;
+    }
+
+    auto frame_buffer = std::move(frame_buffer_);
+    *sequence = sequence_;
+    converting_++;
+    lock.unlock();
+
+    // The cached picture outlives the frame, it must not pin a capture buffer.
+    auto i420_buffer =
+        frame_buffer->has_lease() ? frame_buffer->CopyToI420() : frame_buffer->ToI420();
+    frame_buffer = nullptr;
+
+    lock.lock();
+    converting_--;
+    if (*sequence > converted_sequence_) {
+        i420_buffer_ = i420_buffer;
+        converted_sequence_ = *sequence;
+        converted_time_ = std::chrono::steady_clock::now();
+    }
+    lock.unlock();
+    cond_.notify_all();
+    return i420_buffer;
+}
@@ -0,0 +1,42 @@
+#ifndef LATEST_FRAME_STORE_H_
+#define LATEST_FRAME_STORE_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include "common/v4l2_frame_buffer.h"
+
+/* Hands the newest captured frame to snapshot and thumbnail readers without racing the capture
+ * thread. The capture thread only checks an atomic flag per frame. Once a reader asks for a
+ * frame, the next one is kept (copied first if it does not own its memory), converted to I420
+ * once outside the lock, and shared by every reader waiting for it. The source frame, and with it
+ * any buffer lease, is let go right after the conversion. A recent conversion is served as is. */
+class LatestFrameStore {
+  public:
+    LatestFrameStore();
+
+    void Publish(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer);
+    // Returns the last converted frame right away while it is recent, otherwise waits up to
+    // `timeout` for the next one and falls back to the last converted one (or null). `sequence`
+    // receives the capture sequence of the returned frame, the same frame always has the same one.
+    rtc::scoped_refptr<webrtc::I420BufferInterface>
+    GetI420Frame(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000),
+                 uint64_t *sequence = nullptr);
+    bool has_demand() const;
+
+  private:
+    std::atomic<bool> demand_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    int waiters_;
+    int converting_;
+    uint64_t sequence_;
+    uint64_t converted_sequence_;
+    std::chrono::steady_clock::time_point converted_time_;
+    rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer_;
+    rtc::scoped_refptr<webrtc::I420BufferInterface> i420_buffer_;
+};
+
+#endif // LATEST_FRAME_STORE_H_
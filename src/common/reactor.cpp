@@ -0,0 +1,169 @@
+#include "common/reactor.h"
+#include "common/logging.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <rtc_base/time_utils.h>
+
+static const int kMaxEvents = 16;
+
+std::shared_ptr<Reactor> Reactor::Acquire() {
+    static std::mutex instance_mutex;
+    static std::weak_ptr<Reactor> instance;
+
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    auto shared = instance.lock();
+    if (!shared) {
+        // A handler may drop the last owner, the reactor thread cannot join itself then.
+        shared = std::shared_ptr<Reactor>(new Reactor(), [](Reactor *reactor) {
+            if (reactor->IsCurrent()) {
+                std::thread([reactor]() {
+                    delete reactor;
+                }).detach();
+            } else {
+                delete reactor;
+            }
+        });
+        instance = shared;
+    }
+    return shared;
+}
+
+Reactor::Reactor()
+    : epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      event_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+      abort_(false) {
+    if (epoll_fd_ < 0 || event_fd_ < 0) {
+        ERROR_PRINT("Failed to create the reactor: %s", strerror(errno));
+        exit(-1);
+    }
+
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = event_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, event_fd_, &ev);
+
+    thread_ = rtc::PlatformThread::SpawnJoinable(
+        [this]() {
+            Loop();
+        },
+        "Reactor", rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
+}
+
+Reactor::~Reactor() {
+    abort_.store(true);
+    uint64_t value = 1;
+    if (write(event_fd_, &value, sizeof(value)) < 0) {
+        ERROR_PRINT("Failed to wake up the reactor: %s", strerror(errno));
+    }
+    thread_.Finalize();
+
+    close(event_fd_);
+    close(epoll_fd_);
+    DEBUG_PRINT("Reactor was released!");
+}
+
+bool Reactor::AddFd(int fd, uint32_t events, std::string name, EventHandler handler) {
+    // Handlers drain the fd until EAGAIN.
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        ERROR_PRINT("Failed to set fd(%d) %s non-blocking: %s", fd, name.c_str(), strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        ERROR_PRINT("Failed to watch fd(%d) %s: %s", fd, name.c_str(), strerror(errno));
+        return false;
+    }
+
+    sources_[fd] = {std::move(handler), {std::move(name), 0, 0, 0, 0}};
+    return true;
+}
+
+void Reactor::RemoveFd(int fd) {
+    // Blocks until a handler running on the reactor thread has returned.
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    auto it = sources_.find(fd);
+    if (it == sources_.end()) {
+        return;
+    }
+
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+
+    auto &stats = it->second.stats;
+    if (stats.dispatches > 0) {
+        DEBUG_PRINT("'%s' dispatched %llu times, busy avg %lld us / max %lld us, wait avg %lld us",
+                    stats.name.c_str(), (unsigned long long)stats.dispatches,
+                    (long long)(stats.busy_us / stats.dispatches), (long long)stats.max_busy_us,
+                    (long long)(stats.wait_us / stats.dispatches));
+    }
+    sources_.erase(it);
+}
+
+std::vector<Reactor::Stats> Reactor::GetStats() const {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    std::vector<Stats> stats;
+    for (auto &[fd, source] : sources_) {
+        stats.push_back(source.stats);
+    }
+    return stats;
+}
+
+bool Reactor::IsCurrent() const { return std::this_thread::get_id() == thread_id_.load(); }
+
+void Reactor::Loop() {
+    epoll_event events[kMaxEvents];
+    thread_id_.store(std::this_thread::get_id());
+
+    while (!abort_.load()) {
+        int n = epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+        if (n < 0) {
+            if (errno != EINTR) {
+                ERROR_PRINT("epoll_wait failed: %s", strerror(errno));
+            }
+            continue;
+        }
+
+        const int64_t wakeup_us = rtc::TimeMicros();
+        for (int i = 0; i < n && !abort_.load(); i++) {
+            if (events[i].data.fd == event_fd_) {
+                continue;
+            }
+            Dispatch(events[i].data.fd, events[i].events, wakeup_us);
+        }
+    }
+}
+
+void Reactor::Dispatch(int fd, uint32_t events, int64_t wakeup_us) {
+    std::lock_guard<std::recursive_mutex> lock(mutex_);
+    // An earlier handler in the same batch may have removed this fd.
+    auto it = sources_.find(fd);
+    if (it == sources_.end()) {
+        return;
+    }
+
+    // The handler may remove its own fd, keep it alive until it returns.
+    auto handler = it->second.handler;
+    const int64_t start_us = rtc::TimeMicros();
+    handler(events);
+    const int64_t busy_us = rtc::TimeMicros() - start_us;
+
+    it = sources_.find(fd);
+    if (it == sources_.end()) {
+        return;
+    }
+    auto &stats = it->second.stats;
+    stats.dispatches++;
+    stats.busy_us += busy_us;
+    stats.max_busy_us = std::max(stats.max_busy_us, busy_us);
+    stats.wait_us += start_us - wakeup_us;
+}
@@ -0,0 +1,63 @@
+#ifndef REACTOR_H_
+#define REACTOR_H_
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <rtc_base/platform_thread.h>
+
+/* A single epoll loop shared by every V4L2 device (capture, decode, scale and encode). Devices
+ * register their fd together with a handler, which is invoked on the reactor thread whenever
+ * the fd becomes ready. The loop exits through an eventfd once the last owner releases it. The
+ * per-fd dispatch stats can be read at any time and are logged when the fd is removed. */
+class Reactor {
+  public:
+    using EventHandler = std::function<void(uint32_t events)>;
+
+    struct Stats {
+        std::string name;
+        uint64_t dispatches;
+        int64_t busy_us;     // accumulated time spent in the handler
+        int64_t max_busy_us; // longest single handler call
+        int64_t wait_us;     // accumulated delay between the wakeup and the dispatch
+    };
+
+    static std::shared_ptr<Reactor> Acquire();
+
+    Reactor();
+    ~Reactor();
+
+    bool AddFd(int fd, uint32_t events, std::string name, EventHandler handler);
+    // Once it returns, the handler of `fd` is neither running nor going to run again, unless it is
+    // called from that handler itself.
+    void RemoveFd(int fd);
+    // One entry per registered fd, taken between dispatches.
+    std::vector<Stats> GetStats() const;
+    // Whether the caller runs on the reactor thread, where waiting for a device would deadlock.
+    bool IsCurrent() const;
+
+  private:
+    struct Source {
+        EventHandler handler;
+        Stats stats;
+    };
+
+    int epoll_fd_;
+    int event_fd_;
+    std::atomic<bool> abort_;
+    std::atomic<std::thread::id> thread_id_;
+    mutable std::recursive_mutex mutex_;
+    std::unordered_map<int, Source> sources_;
+    rtc::PlatformThread thread_;
+
+    void Loop();
+    void Dispatch(int fd, uint32_t events, int64_t wakeup_us);
+};
+
+#endif // REACTOR_H_
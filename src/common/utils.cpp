@@ -4,6 +4,7 @@
 #include <iostream>
 #include <iterator>
 #include <sstream>
+#include <string.h>
 #include <sys/statvfs.h>
 #include <uuid/uuid.h>
 
@@ -11,11 +12,39 @@ extern "C" {
 #include <libavformat/avformat.h>
 }
 #include <jpeglib.h>
-#include <third_party/libyuv/include/libyuv.h>
 
 #include "common/logging.h"
 #include "common/utils.h"
 
+namespace {
+
+struct JpegCompressor {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    std::vector<uint8_t> padded_rows;
+
+    JpegCompressor() {
+        cinfo.err = jpeg_std_error(&jerr);
+        jpeg_create_compress(&cinfo);
+    }
+    ~JpegCompressor() { jpeg_destroy_compress(&cinfo); }
+};
+
+// Rows past the bottom repeat the last one. With `scratch`, the row is copied there and padded
+// to `padded_width` by repeating its last pixel.
+JSAMPROW PlaneRow(const uint8_t *plane, int stride, int width, int height, int row,
+                  int padded_width, uint8_t *scratch) {
+    const uint8_t *src = plane + std::min(row, height - 1) * stride;
+    if (!scratch) {
+        return const_cast<uint8_t *>(src);
+    }
+    memcpy(scratch, src, width);
+    memset(scratch + width, src[width - 1], padded_width - width);
+    return scratch;
+}
+
+} // namespace
+
 bool Utils::CreateFolder(const std::string &folder_path) {
     if (folder_path.empty()) {
         return false;
@@ -361,13 +390,19 @@ std::string Utils::PrefixZero(int src, int digits) {
 }
 
 Buffer Utils::ConvertYuvToJpeg(const uint8_t *yuv_data, int width, int height, int quality) {
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
+    const uint8_t *data_u = yuv_data + width * height;
+    const uint8_t *data_v = data_u + (width * height / 4);
+    return ConvertYuvToJpeg(yuv_data, width, data_u, width / 2, data_v, width / 2, width, height,
+                            quality);
+}
 
-    Buffer jpegBuffer;
+Buffer Utils::ConvertYuvToJpeg(const uint8_t *data_y, int stride_y, const uint8_t *data_u,
+                               int stride_u, const uint8_t *data_v, int stride_v, int width,
+                               int height, int quality) {
+    // Set up once per thread, snapshots and thumbnails are taken from several threads.
+    thread_local JpegCompressor compressor;
+    auto &cinfo = compressor.cinfo;
 
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
     uint8_t *data = nullptr;
     unsigned long size = 0;
     jpeg_mem_dest(&cinfo, &data, &size);
@@ -375,29 +410,54 @@ Buffer Utils::ConvertYuvToJpeg(const uint8_t *yuv_data, int width, int height, i
     cinfo.image_width = width;
     cinfo.image_height = height;
     cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_EXT_BGR;
-
+    cinfo.in_color_space = JCS_YCbCr;
     jpeg_set_defaults(&cinfo);
     jpeg_set_quality(&cinfo, quality, TRUE);
 
-    JSAMPROW row_pointer[1];
-    int row_stride = width * 3;
-    uint8_t *rgb_data = (uint8_t *)malloc(width * height * 3);
-    libyuv::I420ToRGB24(yuv_data, width, yuv_data + width * height, width / 2,
-                        yuv_data + width * height + (width * height / 4), width / 2, rgb_data,
-                        width * 3, width, height);
+    // The I420 planes are compressed as they are, without any color conversion or resampling.
+    cinfo.raw_data_in = TRUE;
+    cinfo.comp_info[0].h_samp_factor = cinfo.comp_info[0].v_samp_factor = 2;
+    for (int i = 1; i < 3; i++) {
+        cinfo.comp_info[i].h_samp_factor = cinfo.comp_info[i].v_samp_factor = 1;
+    }
 
-    jpeg_start_compress(&cinfo, TRUE);
+    // libjpeg reads whole 16x16 MCUs, narrower rows are padded in a scratch copy.
+    const int chroma_width = (width + 1) / 2;
+    const int chroma_height = (height + 1) / 2;
+    const int padded_width = (width + 15) & ~15;
+    const int padded_chroma_width = padded_width / 2;
+    uint8_t *scratch = nullptr;
+    if (stride_y < padded_width || stride_u < padded_chroma_width ||
+        stride_v < padded_chroma_width) {
+        compressor.padded_rows.resize(16 * padded_width + 16 * padded_chroma_width);
+        scratch = compressor.padded_rows.data();
+    }
+
+    JSAMPROW rows_y[16], rows_u[8], rows_v[8];
+    JSAMPARRAY planes[3] = {rows_y, rows_u, rows_v};
 
+    jpeg_start_compress(&cinfo, TRUE);
     while (cinfo.next_scanline < cinfo.image_height) {
-        row_pointer[0] = &rgb_data[cinfo.next_scanline * row_stride];
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        const int row = cinfo.next_scanline;
+        for (int i = 0; i < 16; i++) {
+            rows_y[i] = PlaneRow(data_y, stride_y, width, height, row + i, padded_width,
+                                 scratch ? scratch + i * padded_width : nullptr);
+        }
+        uint8_t *chroma_scratch = scratch ? scratch + 16 * padded_width : nullptr;
+        for (int i = 0; i < 8; i++) {
+            rows_u[i] = PlaneRow(data_u, stride_u, chroma_width, chroma_height, row / 2 + i,
+                                 padded_chroma_width,
+                                 scratch ? chroma_scratch + i * padded_chroma_width : nullptr);
+            rows_v[i] = PlaneRow(data_v, stride_v, chroma_width, chroma_height, row / 2 + i,
+                                 padded_chroma_width,
+                                 scratch ? chroma_scratch + (8 + i) * padded_chroma_width
+                                         : nullptr);
+        }
+        jpeg_write_raw_data(&cinfo, planes, 16);
     }
-
     jpeg_finish_compress(&cinfo);
-    jpeg_destroy_compress(&cinfo);
-    free(rgb_data);
 
+    Buffer jpegBuffer;
     jpegBuffer.start = std::unique_ptr<uint8_t, FreeDeleter>(data);
     jpegBuffer.length = size;
 
@@ -417,8 +477,18 @@ void Utils::WriteJpegImage(Buffer buffer, const std::string &url) {
 
 void Utils::CreateJpegImage(const uint8_t *yuv_data, int width, int height, const std::string &url,
                             int quality) {
+    const uint8_t *data_u = yuv_data + width * height;
+    const uint8_t *data_v = data_u + (width * height / 4);
+    CreateJpegImage(yuv_data, width, data_u, width / 2, data_v, width / 2, width, height, url,
+                    quality);
+}
+
+void Utils::CreateJpegImage(const uint8_t *data_y, int stride_y, const uint8_t *data_u,
+                            int stride_u, const uint8_t *data_v, int stride_v, int width,
+                            int height, const std::string &url, int quality) {
     try {
-        auto jpg_buffer = Utils::ConvertYuvToJpeg(yuv_data, width, height, quality);
+        auto jpg_buffer = Utils::ConvertYuvToJpeg(data_y, stride_y, data_u, stride_u, data_v,
+                                                  stride_v, width, height, quality);
         WriteJpegImage(std::move(jpg_buffer), url);
     } catch (const std::exception &e) {
         std::cerr << "Error: " << e.what() << std::endl;
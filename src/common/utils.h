@@ -39,8 +39,14 @@ class Utils {
     static bool CheckDriveSpace(const std::string &file_path, unsigned long min_free_byte);
     static Buffer ConvertYuvToJpeg(const uint8_t *yuv_data, int width, int height,
                                    int quality = 100);
+    static Buffer ConvertYuvToJpeg(const uint8_t *data_y, int stride_y, const uint8_t *data_u,
+                                   int stride_u, const uint8_t *data_v, int stride_v, int width,
+                                   int height, int quality = 100);
     static void CreateJpegImage(const uint8_t *yuv_data, int width, int height,
                                 const std::string &url, int quality);
+    static void CreateJpegImage(const uint8_t *data_y, int stride_y, const uint8_t *data_u,
+                                int stride_u, const uint8_t *data_v, int stride_v, int width,
+                                int height, const std::string &url, int quality);
     static void WriteJpegImage(Buffer buffer, const std::string &url);
     static int GetVideoDuration(const std::string &filePath);
 
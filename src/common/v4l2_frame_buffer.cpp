@@ -1,6 +1,7 @@
 #include "common/v4l2_frame_buffer.h"
 #include "common/logging.h"
 
+#include <rtc_base/memory/aligned_malloc.h>
 #include <third_party/libyuv/include/libyuv.h>
 
 // Aligning pointer to 64 bytes for improved performance, e.g. use SIMD.
@@ -16,7 +17,22 @@ rtc::scoped_refptr<V4L2FrameBuffer> V4L2FrameBuffer::Create(int width, int heigh
     return rtc::make_ref_counted<V4L2FrameBuffer>(width, height, buffer, format);
 }
 
-V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, V4L2Buffer buffer, uint32_t format)
+rtc::scoped_refptr<V4L2FrameBuffer>
+V4L2FrameBuffer::Create(int width, int height, V4L2Buffer buffer, uint32_t format,
+                        std::shared_ptr<BufferLease> lease, std::shared_ptr<FrameBufferPool> pool) {
+    return rtc::make_ref_counted<V4L2FrameBuffer>(width, height, buffer, format, std::move(lease),
+                                                  std::move(pool));
+}
+
+rtc::scoped_refptr<V4L2FrameBuffer> V4L2FrameBuffer::Create(int width, int height,
+                                                            PooledBlock data, V4L2Buffer buffer,
+                                                            uint32_t format) {
+    return rtc::make_ref_counted<V4L2FrameBuffer>(width, height, std::move(data), buffer, format);
+}
+
+V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, V4L2Buffer buffer, uint32_t format,
+                                 std::shared_ptr<BufferLease> lease,
+                                 std::shared_ptr<FrameBufferPool> pool)
     : width_(width),
       height_(height),
       format_(format),
@@ -24,8 +40,21 @@ V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, V4L2Buffer buffer, uint3
       flags_(buffer.flags),
       timestamp_(buffer.timestamp),
       buffer_(buffer),
-      is_buffer_copied(false),
-      data_(static_cast<uint8_t *>(webrtc::AlignedMalloc(size_, kBufferAlignment))) {}
+      lease_(std::move(lease)),
+      pool_(std::move(pool)),
+      is_buffer_copied(false) {}
+
+V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, PooledBlock data, V4L2Buffer buffer,
+                                 uint32_t format)
+    : width_(width),
+      height_(height),
+      format_(format),
+      size_(buffer.length),
+      flags_(buffer.flags),
+      timestamp_(buffer.timestamp),
+      buffer_(buffer),
+      is_buffer_copied(true),
+      data_(std::move(data)) {}
 
 V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, int size, uint32_t format)
     : width_(width),
@@ -35,7 +64,8 @@ V4L2FrameBuffer::V4L2FrameBuffer(int width, int height, int size, uint32_t forma
       flags_(0),
       timestamp_({0, 0}),
       is_buffer_copied(false),
-      data_(static_cast<uint8_t *>(webrtc::AlignedMalloc(size_, kBufferAlignment))) {}
+      data_(static_cast<uint8_t *>(webrtc::AlignedMalloc(size_, kBufferAlignment)),
+            PooledBlockDeleter()) {}
 
 V4L2FrameBuffer::~V4L2FrameBuffer() {}
 
@@ -49,38 +79,134 @@ uint32_t V4L2FrameBuffer::format() const { return format_; }
 
 unsigned int V4L2FrameBuffer::size() const { return size_; }
 
+int V4L2FrameBuffer::stride() const {
+    if (buffer_.stride > 0) {
+        return buffer_.stride;
+    }
+    if (format_ == V4L2_PIX_FMT_YUYV || format_ == V4L2_PIX_FMT_UYVY) {
+        return width_ * 2;
+    }
+    return width_;
+}
+
+unsigned int V4L2FrameBuffer::PlaneOffset(int plane) const {
+    if (plane > 0 && buffer_.plane_offsets[plane] > 0) {
+        return buffer_.plane_offsets[plane];
+    }
+    const unsigned int stride_y = stride();
+    if (plane == 0) {
+        return 0;
+    } else if (plane == 1) {
+        return stride_y * height_;
+    }
+    return stride_y * height_ + ((stride_y + 1) / 2) * ((height_ + 1) / 2);
+}
+
 unsigned int V4L2FrameBuffer::flags() const { return flags_; }
 
 timeval V4L2FrameBuffer::timestamp() const { return timestamp_; }
 
+bool V4L2FrameBuffer::has_lease() const { return lease_ != nullptr; }
+
 rtc::scoped_refptr<webrtc::I420BufferInterface> V4L2FrameBuffer::ToI420() {
+    if (format_ == V4L2_PIX_FMT_YUV420 && !lease_ && buffer_.start) {
+        // Nothing holds the driver buffer, e.g. decoder output, it is requeued once this returns.
+        CopyBufferData();
+    }
+    const uint8_t *data = is_buffer_copied ? data_.get() : (uint8_t *)buffer_.start;
+
+    if (format_ == V4L2_PIX_FMT_YUV420) {
+        // Point straight into the frame, the view keeps it (and its lease) alive.
+        const int stride_y = stride();
+        const int stride_uv = (stride_y + 1) / 2;
+        const uint8_t *data_y = data;
+        const uint8_t *data_u = data + PlaneOffset(1);
+        const uint8_t *data_v = data + PlaneOffset(2);
+        rtc::scoped_refptr<V4L2FrameBuffer> keep_alive(this);
+        return webrtc::WrapI420Buffer(width_, height_, data_y, stride_y, data_u, stride_uv, data_v,
+                                      stride_uv, [keep_alive]() {});
+    }
+
     rtc::scoped_refptr<webrtc::I420Buffer> i420_buffer(webrtc::I420Buffer::Create(width_, height_));
-    i420_buffer->InitializeData();
-
-    if (format_ == V4L2_PIX_FMT_MJPEG) {
-        if (libyuv::ConvertToI420(is_buffer_copied ? data_.get() : (uint8_t *)buffer_.start, size_,
-                                  i420_buffer.get()->MutableDataY(), i420_buffer.get()->StrideY(),
-                                  i420_buffer.get()->MutableDataU(), i420_buffer.get()->StrideU(),
-                                  i420_buffer.get()->MutableDataV(), i420_buffer.get()->StrideV(),
-                                  0, 0, width_, height_, width_, height_, libyuv::kRotate0,
-                                  libyuv::FOURCC_MJPG) < 0) {
+
+    // Raw formats are only converted here, i.e. once a consumer really asks for I420.
+    if (format_ == V4L2_PIX_FMT_NV12) {
+        const uint8_t *data_uv = data + PlaneOffset(1);
+        libyuv::NV12ToI420(data, stride(), data_uv, stride(), i420_buffer->MutableDataY(),
+                           i420_buffer->StrideY(), i420_buffer->MutableDataU(),
+                           i420_buffer->StrideU(), i420_buffer->MutableDataV(),
+                           i420_buffer->StrideV(), width_, height_);
+    } else if (format_ == V4L2_PIX_FMT_YUYV) {
+        libyuv::YUY2ToI420(data, stride(), i420_buffer->MutableDataY(), i420_buffer->StrideY(),
+                           i420_buffer->MutableDataU(), i420_buffer->StrideU(),
+                           i420_buffer->MutableDataV(), i420_buffer->StrideV(), width_, height_);
+    } else if (format_ == V4L2_PIX_FMT_UYVY) {
+        libyuv::UYVYToI420(data, stride(), i420_buffer->MutableDataY(), i420_buffer->StrideY(),
+                           i420_buffer->MutableDataU(), i420_buffer->StrideU(),
+                           i420_buffer->MutableDataV(), i420_buffer->StrideV(), width_, height_);
+    } else if (format_ == V4L2_PIX_FMT_MJPEG) {
+        if (libyuv::ConvertToI420(data, size_, i420_buffer.get()->MutableDataY(),
+                                  i420_buffer.get()->StrideY(), i420_buffer.get()->MutableDataU(),
+                                  i420_buffer.get()->StrideU(), i420_buffer.get()->MutableDataV(),
+                                  i420_buffer.get()->StrideV(), 0, 0, width_, height_, width_,
+                                  height_, libyuv::kRotate0, libyuv::FOURCC_MJPG) < 0) {
             ERROR_PRINT("Mjpeg ConvertToI420 Failed");
         }
-    } else if (format_ == V4L2_PIX_FMT_YUV420) {
-        memcpy(i420_buffer->MutableDataY(),
-               is_buffer_copied ? data_.get() : (uint8_t *)buffer_.start, size_);
     } else if (format_ == V4L2_PIX_FMT_H264) {
         // use hw decoded frame from track.
+        i420_buffer->InitializeData();
     }
 
     return i420_buffer;
 }
 
+rtc::scoped_refptr<webrtc::I420BufferInterface> V4L2FrameBuffer::CopyToI420() {
+    if (format_ == V4L2_PIX_FMT_YUV420) {
+        return webrtc::I420Buffer::Copy(*ToI420());
+    }
+    return ToI420();
+}
+
 void V4L2FrameBuffer::CopyBufferData() {
-    memcpy(data_.get(), (uint8_t *)buffer_.start, size_);
-    is_buffer_copied = true;
+    if (is_buffer_copied.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::call_once(copy_once_, [this]() {
+        if (!data_) {
+            data_ = AllocateData();
+        }
+        memcpy(data_.get(), (uint8_t *)buffer_.start, size_);
+        is_buffer_copied.store(true, std::memory_order_release);
+    });
+}
+
+rtc::scoped_refptr<V4L2FrameBuffer> V4L2FrameBuffer::Copy() {
+    V4L2Buffer buffer = GetRawBuffer();
+    PooledBlock data = AllocateData();
+    memcpy(data.get(), buffer.start, size_);
+    return Create(width_, height_, std::move(data), buffer, format_);
+}
+
+PooledBlock V4L2FrameBuffer::AllocateData() const {
+    if (pool_) {
+        return pool_->Acquire(size_);
+    }
+    return PooledBlock(static_cast<uint8_t *>(webrtc::AlignedMalloc(size_, kBufferAlignment)),
+                       PooledBlockDeleter());
 }
 
-V4L2Buffer V4L2FrameBuffer::GetRawBuffer() { return buffer_; }
+V4L2Buffer V4L2FrameBuffer::GetRawBuffer() {
+    if (!is_buffer_copied) {
+        return buffer_;
+    }
+    V4L2Buffer buffer = buffer_;
+    buffer.start = data_.get();
+    return buffer;
+}
 
-const void *V4L2FrameBuffer::Data() const { return data_.get(); }
+const void *V4L2FrameBuffer::Data() {
+    if (buffer_.start) {
+        CopyBufferData();
+    }
+    return data_.get();
+}
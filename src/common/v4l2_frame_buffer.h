@@ -1,15 +1,18 @@
 #ifndef V4L2_FRAME_BUFFER_H_
 #define V4L2_FRAME_BUFFER_H_
 
+#include "common/buffer_lease.h"
+#include "common/frame_buffer_pool.h"
 #include "common/v4l2_utils.h"
 
 #include <linux/videodev2.h>
+#include <atomic>
+#include <mutex>
 #include <vector>
 
 #include <api/video/i420_buffer.h>
 #include <api/video/video_frame.h>
 #include <common_video/include/video_frame_buffer.h>
-#include <rtc_base/memory/aligned_malloc.h>
 
 class V4L2FrameBuffer : public webrtc::VideoFrameBuffer {
   public:
@@ -17,36 +20,64 @@ class V4L2FrameBuffer : public webrtc::VideoFrameBuffer {
                                                       uint32_t format);
     static rtc::scoped_refptr<V4L2FrameBuffer> Create(int width, int height, V4L2Buffer buffer,
                                                       uint32_t format);
+    static rtc::scoped_refptr<V4L2FrameBuffer>
+    Create(int width, int height, V4L2Buffer buffer, uint32_t format,
+           std::shared_ptr<BufferLease> lease, std::shared_ptr<FrameBufferPool> pool = nullptr);
+    // Takes over already filled memory, `buffer` only describes its length, flags and timestamp.
+    static rtc::scoped_refptr<V4L2FrameBuffer> Create(int width, int height, PooledBlock data,
+                                                      V4L2Buffer buffer, uint32_t format);
 
     Type type() const override;
     int width() const override;
     int height() const override;
+    // YUV420 frames are returned as a view of the frame's memory, which holds on to the frame.
+    // Frames without a lease are copied first, their driver buffer may be refilled any time.
     rtc::scoped_refptr<webrtc::I420BufferInterface> ToI420() override;
+    // Same as `ToI420`, but never refers back to the frame, e.g. to outlive its buffer lease.
+    rtc::scoped_refptr<webrtc::I420BufferInterface> CopyToI420();
 
     uint32_t format() const;
     unsigned int size() const;
+    // Bytes per row of the first plane, rows may be padded beyond the width.
+    int stride() const;
     unsigned int flags() const;
     timeval timestamp() const;
+    bool has_lease() const;
 
+    // Safe to call from several consumers, the first one copies. The lease is kept, others
+    // may still be reading the driver buffer.
     void CopyBufferData();
-    const void *Data() const;
+    // A new frame owning a copy of the data, it holds no lease on the driver buffer.
+    rtc::scoped_refptr<V4L2FrameBuffer> Copy();
+    // Copies the data out of the driver buffer first, if not already done.
+    const void *Data();
     V4L2Buffer GetRawBuffer();
 
   protected:
     V4L2FrameBuffer(int width, int height, int size, uint32_t format);
-    V4L2FrameBuffer(int width, int height, V4L2Buffer buffer, uint32_t format);
+    V4L2FrameBuffer(int width, int height, V4L2Buffer buffer, uint32_t format,
+                    std::shared_ptr<BufferLease> lease = nullptr,
+                    std::shared_ptr<FrameBufferPool> pool = nullptr);
+    V4L2FrameBuffer(int width, int height, PooledBlock data, V4L2Buffer buffer, uint32_t format);
     ~V4L2FrameBuffer() override;
 
   private:
+    unsigned int PlaneOffset(int plane) const;
+    PooledBlock AllocateData() const;
+
     const int width_;
     const int height_;
     const uint32_t format_;
     unsigned int size_;
     unsigned int flags_;
-    bool is_buffer_copied;
+    std::atomic<bool> is_buffer_copied;
+    std::once_flag copy_once_;
     timeval timestamp_;
     V4L2Buffer buffer_;
-    const std::unique_ptr<uint8_t, webrtc::AlignedFreeDeleter> data_;
+    std::shared_ptr<BufferLease> lease_;
+    std::shared_ptr<FrameBufferPool> pool_;
+    // Only allocated once the data is copied out of the driver buffer.
+    PooledBlock data_;
 };
 
 #endif // V4L2_FRAME_BUFFER_H_
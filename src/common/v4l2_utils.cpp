@@ -77,7 +77,9 @@ bool V4L2Util::InitBuffer(int fd, V4L2BufferGroup *gbuffer, v4l2_buf_type type,
 
 bool V4L2Util::DequeueBuffer(int fd, v4l2_buffer *buffer) {
     if (ioctl(fd, VIDIOC_DQBUF, buffer) < 0) {
-        ERROR_PRINT("fd(%d) dequeue buffer: %s", fd, strerror(errno));
+        if (errno != EAGAIN) {
+            ERROR_PRINT("fd(%d) dequeue buffer: %s", fd, strerror(errno));
+        }
         return false;
     }
     return true;
@@ -140,7 +142,7 @@ bool V4L2Util::SetFps(int fd, v4l2_buf_type type, int fps) {
 }
 
 bool V4L2Util::SetFormat(int fd, V4L2BufferGroup *gbuffer, int width, int height,
-                         uint32_t pixel_format) {
+                         uint32_t pixel_format, int stride) {
     v4l2_format fmt = {};
     fmt.type = gbuffer->type;
     ioctl(fd, VIDIOC_G_FMT, &fmt);
@@ -155,6 +157,12 @@ bool V4L2Util::SetFormat(int fd, V4L2BufferGroup *gbuffer, int width, int height
         fmt.fmt.pix_mp.pixelformat = pixel_format;
     }
 
+    // Padded rows are described to the device instead of being repacked.
+    bool has_stride = stride > 0 && V4L2_TYPE_IS_MULTIPLANAR(gbuffer->type);
+    if (has_stride) {
+        fmt.fmt.pix_mp.plane_fmt[0].bytesperline = stride;
+    }
+
     if (ioctl(fd, VIDIOC_S_FMT, &fmt) < 0) {
         ERROR_PRINT("fd(%d) set format(%s) : %s", fd,
                     V4L2Util::FourccToString(fmt.fmt.pix_mp.pixelformat).c_str(), strerror(errno));
@@ -165,6 +173,19 @@ bool V4L2Util::SetFormat(int fd, V4L2BufferGroup *gbuffer, int width, int height
                 V4L2Util::FourccToString(fmt.fmt.pix_mp.pixelformat).c_str(), fmt.fmt.pix_mp.width,
                 fmt.fmt.pix_mp.height);
 
+    if (width > 0 && height > 0 && fmt.fmt.pix_mp.pixelformat != pixel_format) {
+        ERROR_PRINT("fd(%d) format %s is not supported, the driver picked %s", fd,
+                    V4L2Util::FourccToString(pixel_format).c_str(),
+                    V4L2Util::FourccToString(fmt.fmt.pix_mp.pixelformat).c_str());
+        return false;
+    }
+
+    if (has_stride && fmt.fmt.pix_mp.plane_fmt[0].bytesperline != (uint32_t)stride) {
+        ERROR_PRINT("fd(%d) stride %d is not supported, the driver picked %d", fd, stride,
+                    fmt.fmt.pix_mp.plane_fmt[0].bytesperline);
+        return false;
+    }
+
     if (fmt.fmt.pix_mp.width != width || fmt.fmt.pix_mp.height != height) {
         ERROR_PRINT("fd(%d) input size (%dx%d) doesn't match driver's output size (%dx%d): %s", fd,
                     width, height, fmt.fmt.pix_mp.width, fmt.fmt.pix_mp.height, strerror(EINVAL));
@@ -13,7 +13,10 @@ struct V4L2Buffer {
     unsigned int flags = 0;
     int dmafd = 0;
     struct timeval timestamp = {0, 0};
-    struct v4l2_buffer inner;
+    // Bytes per row of the first plane and where each plane starts, 0 when tightly packed.
+    unsigned int stride = 0;
+    unsigned int plane_offsets[3] = {0, 0, 0};
+    struct v4l2_buffer inner = {};
     struct v4l2_plane plane;
 
     V4L2Buffer() = default;
@@ -55,7 +58,7 @@ class V4L2Util {
     static bool SubscribeEvent(int fd, uint32_t type);
     static bool SetFps(int fd, v4l2_buf_type type, int fps);
     static bool SetFormat(int fd, V4L2BufferGroup *gbuffer, int width, int height,
-                          uint32_t pixel_format);
+                          uint32_t pixel_format, int stride = 0);
     static bool SetCtrl(int fd, uint32_t id, int32_t value);
     static bool SetExtCtrl(int fd, uint32_t id, int32_t value);
     static bool StreamOn(int fd, v4l2_buf_type type);
@@ -3,6 +3,7 @@
 
 Worker::Worker(std::string name, std::function<void()> executing_function)
     : abort_(false),
+      thread_id_(),
       name_(name),
       executing_function_(executing_function) {}
 
@@ -20,7 +21,12 @@ void Worker::Run() {
         "CaptureThread", rtc::ThreadAttributes().SetPriority(rtc::ThreadPriority::kHigh));
 }
 
+void Worker::Stop() { abort_.store(true); }
+
+bool Worker::IsCurrent() const { return std::this_thread::get_id() == thread_id_.load(); }
+
 void Worker::Thread() {
+    thread_id_.store(std::this_thread::get_id());
     while (!abort_.load()) {
         executing_function_();
     }
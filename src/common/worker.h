@@ -4,6 +4,7 @@
 #include <atomic>
 #include <functional>
 #include <string>
+#include <thread>
 
 #include <rtc_base/platform_thread.h>
 
@@ -12,9 +13,13 @@ class Worker {
     Worker(std::string name, std::function<void()> executing_function);
     ~Worker();
     void Run();
+    // Lets the loop exit after the current call without waiting for it, the destructor joins.
+    void Stop();
+    bool IsCurrent() const;
 
   private:
     std::atomic<bool> abort_;
+    std::atomic<std::thread::id> thread_id_;
     std::string name_;
     std::function<void()> executing_function_;
     rtc::PlatformThread thread_;
@@ -20,15 +20,18 @@
 #include <pc/video_track_source_proxy.h>
 #include <rtc_base/ssl_adapter.h>
 
+#include "capturer/file_capturer.h"
 #include "capturer/libcamera_capturer.h"
 #include "capturer/v4l2_capturer.h"
 #include "common/logging.h"
 #include "common/utils.h"
 #include "customized_video_encoder_factory.h"
+#include "track/passthrough_track_source.h"
 #include "track/v4l2dma_track_source.h"
 
 std::shared_ptr<Conductor> Conductor::Create(Args args) {
     auto ptr = std::make_shared<Conductor>(args);
+    ptr->InitializeVideoSource();
     ptr->InitializePeerConnectionFactory();
     ptr->InitializeTracks();
     return ptr;
@@ -43,6 +46,25 @@ std::shared_ptr<PaCapturer> Conductor::AudioSource() const { return audio_captur
 
 std::shared_ptr<VideoCapturer> Conductor::VideoSource() const { return video_capture_source_; }
 
+void Conductor::InitializeVideoSource() {
+    if (args.camera.empty()) {
+        return;
+    }
+
+    // The encoder factory needs the capturer to forward key frame requests in passthrough mode.
+    video_capture_source_ = ([this]() -> std::shared_ptr<VideoCapturer> {
+        if (args.use_file) {
+            return FileCapturer::Create(args);
+        } else if (args.use_libcamera) {
+            return LibcameraCapturer::Create(args);
+        } else {
+            return V4L2Capturer::Create(args);
+        }
+    })();
+    jpeg_encoder_ = JpegEncoder::Acquire();
+    snapshot_cache_ = SnapshotCache::Create(jpeg_encoder_);
+}
+
 void Conductor::InitializeTracks() {
     if (audio_track_ == nullptr && !args.no_audio) {
         audio_capture_source_ = PaCapturer::Create(args);
@@ -50,17 +72,11 @@ void Conductor::InitializeTracks() {
         audio_track_ = peer_connection_factory_->CreateAudioTrack("audio_track", options.get());
     }
 
-    if (video_track_ == nullptr && !args.camera.empty()) {
-        video_capture_source_ = ([this]() -> std::shared_ptr<VideoCapturer> {
-            if (args.use_libcamera) {
-                return LibcameraCapturer::Create(args);
-            } else {
-                return V4L2Capturer::Create(args);
-            }
-        })();
-
+    if (video_track_ == nullptr && video_capture_source_) {
         video_track_source_ = ([this]() -> rtc::scoped_refptr<ScaleTrackSource> {
-            if (args.hw_accel) {
+            if (args.hw_accel && video_capture_source_->format() == V4L2_PIX_FMT_H264) {
+                return PassthroughTrackSource::Create(video_capture_source_);
+            } else if (args.hw_accel) {
                 return V4L2DmaTrackSource::Create(video_capture_source_);
             } else {
                 return ScaleTrackSource::Create(video_capture_source_);
@@ -154,15 +170,26 @@ rtc::scoped_refptr<RtcPeer> Conductor::CreatePeerConnection(PeerConfig config) {
 
 void Conductor::OnSnapshot(std::shared_ptr<DataChannelSubject> datachannel, std::string &msg) {
     try {
+        // "<quality> [<width> [<height>]]", the size asks for a downscaled preview.
         std::stringstream ss(msg);
         int num;
         ss >> num;
         int quality = ss.fail() ? 100 : num;
+        int width = 0, height = 0;
+        ss >> width >> height;
 
-        auto i420buff = video_capture_source_->GetI420Frame();
-        auto jpg_buffer =
-            Utils::ConvertYuvToJpeg(i420buff->DataY(), args.width, args.height, quality);
-        datachannel->Send(std::move(jpg_buffer));
+        uint64_t sequence = 0;
+        auto i420buff = video_capture_source_->GetI420Frame(&sequence);
+        if (!i420buff) {
+            ERROR_PRINT("No frame is available for the snapshot.");
+            return;
+        }
+        auto jpg_buffer = snapshot_cache_->Get(i420buff, sequence, quality, width, height);
+        if (!jpg_buffer) {
+            ERROR_PRINT("Failed to encode the snapshot.");
+            return;
+        }
+        datachannel->Send(*jpg_buffer);
     } catch (const std::exception &e) {
         ERROR_PRINT("%s", e.what());
     }
@@ -280,7 +307,8 @@ void Conductor::InitializePeerConnectionFactory() {
     media_dependencies.audio_decoder_factory = webrtc::CreateBuiltinAudioDecoderFactory();
     media_dependencies.audio_processing = webrtc::AudioProcessingBuilder().Create();
     media_dependencies.audio_mixer = nullptr;
-    media_dependencies.video_encoder_factory = CreateCustomizedVideoEncoderFactory(args);
+    media_dependencies.video_encoder_factory =
+        CreateCustomizedVideoEncoderFactory(args, video_capture_source_);
     media_dependencies.video_decoder_factory = std::make_unique<webrtc::VideoDecoderFactoryTemplate<
         webrtc::OpenH264DecoderTemplateAdapter, webrtc::LibvpxVp8DecoderTemplateAdapter,
         webrtc::LibvpxVp9DecoderTemplateAdapter, webrtc::Dav1dDecoderTemplateAdapter>>();
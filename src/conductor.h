@@ -13,6 +13,8 @@
 #include "args.h"
 #include "capturer/pa_capturer.h"
 #include "capturer/video_capturer.h"
+#include "codecs/jpeg/jpeg_encoder.h"
+#include "codecs/jpeg/snapshot_cache.h"
 #include "rtc_peer.h"
 #include "track/scale_track_source.h"
 
@@ -31,6 +33,7 @@ class Conductor {
   private:
     Args args;
 
+    void InitializeVideoSource();
     void InitializePeerConnectionFactory();
     void InitializeTracks();
     void AddTracks(rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection);
@@ -46,6 +49,8 @@ class Conductor {
 
     std::shared_ptr<PaCapturer> audio_capture_source_;
     std::shared_ptr<VideoCapturer> video_capture_source_;
+    std::shared_ptr<JpegEncoder> jpeg_encoder_;
+    std::unique_ptr<SnapshotCache> snapshot_cache_;
     rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> peer_connection_factory_;
     rtc::scoped_refptr<webrtc::AudioTrackInterface> audio_track_;
     rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track_;
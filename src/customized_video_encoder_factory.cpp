@@ -1,5 +1,6 @@
 #include "customized_video_encoder_factory.h"
 #include "codecs/v4l2/v4l2_h264_encoder.h"
+#include "codecs/v4l2/v4l2_passthrough_encoder.h"
 
 #include <modules/video_coding/codecs/av1/av1_svc_config.h>
 #include <modules/video_coding/codecs/av1/libaom_av1_encoder.h>
@@ -7,14 +8,22 @@
 #include <modules/video_coding/codecs/vp8/include/vp8.h>
 #include <modules/video_coding/codecs/vp9/include/vp9.h>
 
-std::unique_ptr<webrtc::VideoEncoderFactory> CreateCustomizedVideoEncoderFactory(Args args) {
-    return std::make_unique<CustomizedVideoEncoderFactory>(args);
+std::unique_ptr<webrtc::VideoEncoderFactory>
+CreateCustomizedVideoEncoderFactory(Args args, std::shared_ptr<VideoCapturer> video_src) {
+    return std::make_unique<CustomizedVideoEncoderFactory>(args, video_src);
 }
 
 std::vector<webrtc::SdpVideoFormat> CustomizedVideoEncoderFactory::GetSupportedFormats() const {
     std::vector<webrtc::SdpVideoFormat> supported_codecs;
 
-    if (args_.hw_accel) {
+    if (IsPassthrough()) {
+        // The camera stream is sent as is, in the profile it is recorded with.
+        for (auto profile : {webrtc::H264Profile::kProfileConstrainedHigh,
+                             webrtc::H264Profile::kProfileHigh}) {
+            supported_codecs.push_back(CreateH264Format(profile, webrtc::H264Level::kLevel4, "1"));
+            supported_codecs.push_back(CreateH264Format(profile, webrtc::H264Level::kLevel4, "0"));
+        }
+    } else if (args_.hw_accel) {
         // hw h264
         supported_codecs.push_back(CreateH264Format(
             webrtc::H264Profile::kProfileConstrainedBaseline, webrtc::H264Level::kLevel4, "1"));
@@ -47,7 +56,12 @@ std::vector<webrtc::SdpVideoFormat> CustomizedVideoEncoderFactory::GetSupportedF
 std::unique_ptr<webrtc::VideoEncoder>
 CustomizedVideoEncoderFactory::CreateVideoEncoder(const webrtc::SdpVideoFormat &format) {
     if (absl::EqualsIgnoreCase(format.name, cricket::kH264CodecName)) {
-        if (args_.hw_accel) {
+        if (IsPassthrough()) {
+            auto video_src = video_src_;
+            return V4L2PassthroughEncoder::Create([video_src]() {
+                video_src->RequestKeyFrame();
+            });
+        } else if (args_.hw_accel) {
             return V4L2H264Encoder::Create(args_);
         } else {
             return webrtc::H264Encoder::Create(cricket::VideoCodec(format));
@@ -62,3 +76,7 @@ CustomizedVideoEncoderFactory::CreateVideoEncoder(const webrtc::SdpVideoFormat &
 
     return nullptr;
 }
+
+bool CustomizedVideoEncoderFactory::IsPassthrough() const {
+    return args_.hw_accel && video_src_ && video_src_->format() == V4L2_PIX_FMT_H264;
+}
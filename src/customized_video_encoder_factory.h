@@ -4,13 +4,16 @@
 #include <api/video_codecs/video_encoder_factory.h>
 
 #include "args.h"
+#include "capturer/video_capturer.h"
 
-std::unique_ptr<webrtc::VideoEncoderFactory> CreateCustomizedVideoEncoderFactory(Args args);
+std::unique_ptr<webrtc::VideoEncoderFactory>
+CreateCustomizedVideoEncoderFactory(Args args, std::shared_ptr<VideoCapturer> video_src);
 
 class CustomizedVideoEncoderFactory : public webrtc::VideoEncoderFactory {
   public:
-    CustomizedVideoEncoderFactory(Args args)
-        : args_(args){};
+    CustomizedVideoEncoderFactory(Args args, std::shared_ptr<VideoCapturer> video_src)
+        : args_(args),
+          video_src_(video_src){};
     ~CustomizedVideoEncoderFactory() = default;
 
     std::vector<webrtc::SdpVideoFormat> GetSupportedFormats() const override;
@@ -20,6 +23,9 @@ class CustomizedVideoEncoderFactory : public webrtc::VideoEncoderFactory {
 
   private:
     Args args_;
+    std::shared_ptr<VideoCapturer> video_src_;
+
+    bool IsPassthrough() const;
 };
 
 #endif // CUSTOMIZED_VIDEO_ENCODER_FACTORY_H_
@@ -35,14 +35,16 @@ void DataChannelSubject::Next(std::string message) {
         if (content.empty()) {
             return;
         }
-        observers_ = observers_map_[type];
-        observers_.insert(observers_.end(), observers_map_[CommandType::UNKNOWN].begin(),
-                          observers_map_[CommandType::UNKNOWN].end());
-
-        for (auto &observer : observers_) {
-            if (observer->subscribed_func_ != nullptr) {
-                observer->subscribed_func_(content);
-            }
+        ObserverList observers;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            observers = observers_map_[type];
+            observers.insert(observers.end(), observers_map_[CommandType::UNKNOWN].begin(),
+                             observers_map_[CommandType::UNKNOWN].end());
+        }
+
+        for (auto &observer : observers) {
+            observer->Emit(content);
         }
     } catch (const json::parse_error &e) {
         ERROR_PRINT("JSON parse error, %s, occur at position: %lu", e.what(), e.byte);
@@ -51,17 +53,20 @@ void DataChannelSubject::Next(std::string message) {
 
 std::shared_ptr<Observable<std::string>> DataChannelSubject::AsObservable() {
     auto observer = std::make_shared<Observable<std::string>>();
+    std::lock_guard<std::mutex> lock(mutex_);
     observers_map_[CommandType::UNKNOWN].push_back(observer);
     return observer;
 }
 
 std::shared_ptr<Observable<std::string>> DataChannelSubject::AsObservable(CommandType type) {
     auto observer = std::make_shared<Observable<std::string>>();
+    std::lock_guard<std::mutex> lock(mutex_);
     observers_map_[type].push_back(observer);
     return observer;
 }
 
 void DataChannelSubject::UnSubscribe() {
+    std::lock_guard<std::mutex> lock(mutex_);
     for (auto &[type, observers] : observers_map_) {
         observers.clear();
     }
@@ -116,7 +121,7 @@ void DataChannelSubject::Send(MetaMessage metadata) {
     Send(type, nullptr, 0);
 }
 
-void DataChannelSubject::Send(Buffer image) {
+void DataChannelSubject::Send(const Buffer &image) {
     const int file_size = image.length;
     auto type = CommandType::SNAPSHOT;
     std::string size_str = std::to_string(file_size);
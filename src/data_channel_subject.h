@@ -86,13 +86,13 @@ class DataChannelSubject : public webrtc::DataChannelObserver,
     void UnSubscribe() override;
 
     void Send(MetaMessage metadata);
-    void Send(Buffer image);
+    void Send(const Buffer &image);
     void Send(std::ifstream &file);
     void SetDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel);
 
   private:
     rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel_;
-    std::map<CommandType, std::vector<std::shared_ptr<Observable<std::string>>>> observers_map_;
+    std::map<CommandType, ObserverList> observers_map_;
 
     void Send(const uint8_t *data, size_t size);
     void Send(CommandType type, const uint8_t *data, size_t size);
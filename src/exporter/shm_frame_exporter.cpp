@@ -0,0 +1,234 @@
+#include "exporter/shm_frame_exporter.h"
+
+#include <climits>
+#include <fcntl.h>
+#include <thread>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <rtc_base/time_utils.h>
+#include <third_party/libyuv/include/libyuv.h>
+
+#include "common/logging.h"
+
+static const size_t kPageSize = 4096;
+// Only the newest due frame waits for the worker.
+static const int kFrameQueueDepth = 1;
+// How often the worker looks for a reader while no frame arrives.
+static const std::chrono::milliseconds kReaderCheckInterval(100);
+static const int64_t kReaderTimeoutUs = 2000000;
+
+std::unique_ptr<ShmFrameExporter> ShmFrameExporter::Create(std::shared_ptr<VideoCapturer> capturer,
+                                                           Args args) {
+    auto ptr = std::make_unique<ShmFrameExporter>(std::move(capturer), args);
+    ptr->Init();
+    ptr->Start();
+    return ptr;
+}
+
+ShmFrameExporter::ShmFrameExporter(std::shared_ptr<VideoCapturer> capturer, Args args)
+    : capturer_(std::move(capturer)),
+      name_(args.shm_name),
+      fps_(args.shm_fps),
+      width_(args.shm_width > 0 ? args.shm_width : capturer_->width()),
+      height_(args.shm_height > 0 ? args.shm_height : capturer_->height()),
+      slot_count_(args.shm_slots),
+      slot_size_(0),
+      size_(0),
+      data_(nullptr),
+      header_(nullptr),
+      sequence_(0),
+      next_timestamp_us_(0),
+      // Only key frames are decoded then, for snapshots.
+      is_passthrough_(capturer_->format() == V4L2_PIX_FMT_H264 && capturer_->config().hw_accel),
+      frames_(kFrameQueueDepth,
+              BoundedQueue<rtc::scoped_refptr<V4L2FrameBuffer>>::Overflow::DropOldest) {}
+
+ShmFrameExporter::~ShmFrameExporter() {
+    if (observer_) {
+        observer_->UnSubscribe();
+    }
+    frames_.shutdown();
+    worker_.reset();
+    if (data_) {
+        munmap(data_, size_);
+        shm_unlink(name_.c_str());
+    }
+}
+
+void ShmFrameExporter::Init() {
+    const size_t chroma_size = ((width_ + 1) / 2) * ((height_ + 1) / 2);
+    const size_t frame_size = width_ * height_ + 2 * chroma_size;
+    slot_size_ = (sizeof(ShmSlotHeader) + frame_size + kPageSize - 1) / kPageSize * kPageSize;
+    size_ = kPageSize + slot_count_ * slot_size_;
+
+    // Readers write their heartbeat and waiter count, so the group needs write access too, and
+    // unlike the open mode fchmod is not masked by the umask.
+    int fd = shm_open(name_.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0660);
+    if (fd < 0 || fchmod(fd, 0660) < 0 || ftruncate(fd, size_) < 0) {
+        ERROR_PRINT("Failed to create shared memory %s: %s", name_.c_str(), strerror(errno));
+        exit(1);
+    }
+    void *data = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        ERROR_PRINT("Failed to map shared memory %s: %s", name_.c_str(), strerror(errno));
+        exit(1);
+    }
+    data_ = static_cast<uint8_t *>(data);
+
+    // The planes never move, so the slot headers are filled in once.
+    for (int i = 0; i < slot_count_; i++) {
+        auto *slot = Slot(i);
+        slot->format = V4L2_PIX_FMT_YUV420;
+        slot->width = width_;
+        slot->height = height_;
+        slot->size = frame_size;
+        slot->strides[0] = width_;
+        slot->strides[1] = slot->strides[2] = (width_ + 1) / 2;
+        slot->offsets[0] = sizeof(ShmSlotHeader);
+        slot->offsets[1] = slot->offsets[0] + width_ * height_;
+        slot->offsets[2] = slot->offsets[1] + chroma_size;
+    }
+
+    header_ = reinterpret_cast<ShmRingHeader *>(data_);
+    header_->version = kShmRingVersion;
+    header_->slot_count = slot_count_;
+    header_->slot_size = slot_size_;
+    header_->width = width_;
+    header_->height = height_;
+    header_->format = V4L2_PIX_FMT_YUV420;
+    // Readers check the magic last, it tells them the header is complete.
+    __atomic_store_n(&header_->magic, kShmRingMagic, __ATOMIC_RELEASE);
+
+    INFO_PRINT("Exporting %dx%d frames at %s fps into shared memory %s (%d slots)", width_,
+               height_, fps_ > 0 ? std::to_string(fps_).c_str() : "capture", name_.c_str(),
+               slot_count_);
+}
+
+void ShmFrameExporter::Start() {
+    if (!is_passthrough_) {
+        observer_ = capturer_->AsFrameBufferObservable();
+    }
+    worker_ = std::make_unique<Worker>("ShmExport", [this]() {
+        ExportNext();
+    });
+    worker_->Run();
+}
+
+bool ShmFrameExporter::HasReader() const {
+    if (__atomic_load_n(&header_->waiters, __ATOMIC_ACQUIRE) > 0) {
+        return true;
+    }
+    int64_t heartbeat_us = __atomic_load_n(&header_->reader_heartbeat_us, __ATOMIC_ACQUIRE);
+    return heartbeat_us > 0 && rtc::TimeMicros() - heartbeat_us < kReaderTimeoutUs;
+}
+
+void ShmFrameExporter::UpdateSubscription() {
+    // Unsubscribed, the capturer may skip decoding frames nobody else wants.
+    bool has_reader = HasReader();
+    if (has_reader == observer_->is_subscribed()) {
+        return;
+    }
+    if (has_reader) {
+        DEBUG_PRINT("A reader attached to %s", name_.c_str());
+        observer_->Subscribe([this](rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+            OnFrameCaptured(frame_buffer);
+        });
+    } else {
+        DEBUG_PRINT("The last reader left %s", name_.c_str());
+        observer_->UnSubscribe();
+        frames_.try_pop();
+    }
+}
+
+ShmSlotHeader *ShmFrameExporter::Slot(uint64_t sequence) {
+    return reinterpret_cast<ShmSlotHeader *>(data_ + kPageSize +
+                                             (sequence % slot_count_) * slot_size_);
+}
+
+void ShmFrameExporter::OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+    timeval tv = frame_buffer->timestamp();
+    int64_t timestamp_us = tv.tv_sec * 1000000LL + tv.tv_usec;
+    if (timestamp_us == 0) {
+        timestamp_us = rtc::TimeMicros();
+    }
+    if (fps_ > 0) {
+        // Half an interval of slack absorbs capture jitter, the schedule keeps the average rate.
+        const int64_t interval_us = 1000000 / fps_;
+        if (timestamp_us < next_timestamp_us_ - interval_us / 2) {
+            return;
+        }
+        if (timestamp_us - next_timestamp_us_ > interval_us) {
+            next_timestamp_us_ = timestamp_us;
+        }
+        next_timestamp_us_ += interval_us;
+    }
+
+    // The driver refills a buffer without a lease once this returns.
+    frames_.push(frame_buffer->has_lease() ? frame_buffer : frame_buffer->Copy());
+}
+
+void ShmFrameExporter::ExportNext() {
+    if (is_passthrough_) {
+        ExportSnapshot();
+        return;
+    }
+
+    UpdateSubscription();
+    auto frame_buffer = frames_.wait_pop(kReaderCheckInterval);
+    if (!frame_buffer) {
+        return;
+    }
+
+    timeval tv = (*frame_buffer)->timestamp();
+    int64_t timestamp_us = tv.tv_sec * 1000000LL + tv.tv_usec;
+    auto i420 = (*frame_buffer)->ToI420();
+    if (i420) {
+        Write(*i420, timestamp_us > 0 ? timestamp_us : rtc::TimeMicros());
+    }
+}
+
+void ShmFrameExporter::ExportSnapshot() {
+    auto interval = fps_ > 0 ? std::chrono::milliseconds(1000 / fps_) : kReaderCheckInterval;
+    if (HasReader()) {
+        // A new picture arrives with every key frame, which the capturer requests on demand.
+        auto i420 = capturer_->GetI420Frame();
+        if (i420 && i420 != last_snapshot_) {
+            last_snapshot_ = i420;
+            Write(*i420, rtc::TimeMicros());
+        }
+    } else {
+        last_snapshot_ = nullptr;
+    }
+    std::this_thread::sleep_for(interval);
+}
+
+void ShmFrameExporter::Write(const webrtc::I420BufferInterface &i420, int64_t timestamp_us) {
+    const uint64_t sequence = ++sequence_;
+    auto *slot = Slot(sequence);
+    uint8_t *base = reinterpret_cast<uint8_t *>(slot);
+    const uint64_t lock = slot->lock;
+    __atomic_store_n(&slot->lock, lock + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    libyuv::I420Scale(i420.DataY(), i420.StrideY(), i420.DataU(), i420.StrideU(), i420.DataV(),
+                      i420.StrideV(), i420.width(), i420.height(), base + slot->offsets[0],
+                      slot->strides[0], base + slot->offsets[1], slot->strides[1],
+                      base + slot->offsets[2], slot->strides[2], width_, height_,
+                      libyuv::kFilterBox);
+    slot->sequence = sequence;
+    slot->timestamp_us = timestamp_us;
+
+    __atomic_store_n(&slot->lock, lock + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&header_->latest_sequence, sequence, __ATOMIC_RELEASE);
+    // Ordered before the waiters check, a reader counted after it sees the new futex value.
+    __atomic_add_fetch(&header_->futex, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&header_->waiters, __ATOMIC_SEQ_CST) > 0) {
+        syscall(SYS_futex, &header_->futex, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef SHM_FRAME_EXPORTER_H_
+#define SHM_FRAME_EXPORTER_H_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "args.h"
+#include "capturer/video_capturer.h"
+#include "common/bounded_queue.h"
+#include "common/worker.h"
+
+/* The layout of the shared memory ring, readers map it read-write with `shm_open(name)` to
+ * register themselves. The segment is only accessible to the exporter's user and group.
+ *
+ * A `ShmRingHeader` is followed by `slot_count` slots of `slot_size` bytes, each one a
+ * `ShmSlotHeader` and then the I420 planes at `offsets[]` from the start of the slot. Frame `n`
+ * goes into slot `n % slot_count`. Every write bumps `futex`, so readers may FUTEX_WAIT on it (or
+ * simply poll `latest_sequence`). The writer never waits for readers, a slot is a seqlock instead:
+ * copy the frame out or work on it in place, then check that `lock` is still the even value it
+ * had before, otherwise the frame was overwritten meanwhile.
+ *
+ * Frames are only written while a reader is attached, i.e. it stored its CLOCK_MONOTONIC time in
+ * `reader_heartbeat_us` within the last two seconds, or it is waiting on the futex. A waiting
+ * reader increments `waiters` before it reads `futex` and decrements it after FUTEX_WAIT, the
+ * writer skips the FUTEX_WAKE while nobody waits. */
+static const uint32_t kShmRingMagic = 0x46574950; // "PIWF"
+static const uint32_t kShmRingVersion = 2;
+
+struct ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t format; // fourcc, always V4L2_PIX_FMT_YUV420
+    uint32_t futex;
+    uint64_t latest_sequence; // newest complete frame, 0 before the first one
+    uint32_t waiters;
+    uint32_t reserved0;
+    int64_t reader_heartbeat_us;
+    uint8_t reserved[8];
+};
+
+struct ShmSlotHeader {
+    uint64_t lock; // odd while the slot is being written
+    uint64_t sequence;
+    int64_t timestamp_us; // capture time, CLOCK_MONOTONIC
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;
+    uint32_t strides[3];
+    uint32_t offsets[3];
+};
+
+static_assert(sizeof(ShmRingHeader) == 64 && sizeof(ShmSlotHeader) == 64);
+
+/* Publishes decoded camera frames, scaled to its own size and rate, into a POSIX shared memory
+ * ring so local analytics can read them without another capture or encode. The capture thread
+ * only queues due frames, they are converted and scaled on a worker. H264 passthrough streams
+ * are never decoded in full, the worker exports the capturer's snapshot frames instead. */
+class ShmFrameExporter {
+  public:
+    static std::unique_ptr<ShmFrameExporter> Create(std::shared_ptr<VideoCapturer> capturer,
+                                                    Args args);
+
+    ShmFrameExporter(std::shared_ptr<VideoCapturer> capturer, Args args);
+    ~ShmFrameExporter();
+
+  private:
+    std::shared_ptr<VideoCapturer> capturer_;
+    std::string name_;
+    int fps_;
+    int width_;
+    int height_;
+    int slot_count_;
+    size_t slot_size_;
+    size_t size_;
+    uint8_t *data_;
+    ShmRingHeader *header_;
+    uint64_t sequence_;
+    int64_t next_timestamp_us_;
+    bool is_passthrough_;
+    rtc::scoped_refptr<webrtc::I420BufferInterface> last_snapshot_;
+    BoundedQueue<rtc::scoped_refptr<V4L2FrameBuffer>> frames_;
+    std::shared_ptr<Observable<rtc::scoped_refptr<V4L2FrameBuffer>>> observer_;
+    std::unique_ptr<Worker> worker_;
+
+    void Init();
+    void Start();
+    bool HasReader() const;
+    void UpdateSubscription();
+    void OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer);
+    void ExportNext();
+    void ExportSnapshot();
+    void Write(const webrtc::I420BufferInterface &i420, int64_t timestamp_us);
+    ShmSlotHeader *Slot(uint64_t sequence);
+};
+
+#endif // SHM_FRAME_EXPORTER_H_
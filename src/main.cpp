@@ -4,6 +4,7 @@
 #include "common/logging.h"
 #include "common/utils.h"
 #include "conductor.h"
+#include "exporter/shm_frame_exporter.h"
 #include "parser.h"
 #include "recorder/recorder_manager.h"
 #include "signaling/http_service.h"
@@ -25,6 +26,11 @@ int main(int argc, char *argv[]) {
         DEBUG_PRINT("Recorder is not started!");
     }
 
+    std::unique_ptr<ShmFrameExporter> shm_exporter;
+    if (!args.shm_name.empty() && conductor->VideoSource()) {
+        shm_exporter = ShmFrameExporter::Create(conductor->VideoSource(), args);
+    }
+
     boost::asio::io_context ioc_;
     boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_guard(
         ioc_.get_executor());
@@ -10,6 +10,9 @@ static const std::unordered_map<std::string, int> format_map = {
     {"mjpeg", V4L2_PIX_FMT_MJPEG},
     {"h264", V4L2_PIX_FMT_H264},
     {"i420", V4L2_PIX_FMT_YUV420},
+    {"nv12", V4L2_PIX_FMT_NV12},
+    {"yuyv", V4L2_PIX_FMT_YUYV},
+    {"uyvy", V4L2_PIX_FMT_UYVY},
 };
 
 template <typename T> void SetIfExists(bpo::variables_map &vm, const std::string &key, T &arg) {
@@ -27,6 +30,11 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
         ("fps", bpo::value<int>()->default_value(args.fps), "Set camera frame rate")
         ("width", bpo::value<int>()->default_value(args.width), "Set camera frame width")
         ("height", bpo::value<int>()->default_value(args.height), "Set camera frame height")
+        ("record_width", bpo::value<int>()->default_value(args.record_width),
+            "Record from a second libcamera stream of this width, the ISP scales the frames "
+            "for WebRTC and snapshots to `--width`. 0 records the WebRTC stream.")
+        ("record_height", bpo::value<int>()->default_value(args.record_height),
+            "Set the height of the recording stream, see `--record_width`")
         ("jpeg_quality", bpo::value<int>()->default_value(args.jpeg_quality),
             "Set the default quality of the snapshot and thumbnail image")
         ("rotation_angle", bpo::value<int>()->default_value(args.rotation_angle),
@@ -35,9 +43,38 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
             "The connection timeout, in seconds, after receiving a remote offer")
         ("segment_duration", bpo::value<int>()->default_value(args.segment_duration),
             "The length (in seconds) of each MP4 recording.")
+        ("record_fragmented", bpo::bool_switch()->default_value(args.record_fragmented),
+            "Write recordings as fragmented MP4. Files stay playable while they are written and "
+            "keep everything up to the last fragment if the device loses power.")
+        ("record_fragment_duration",
+            bpo::value<int>()->default_value(args.record_fragment_duration),
+            "The minimum length (in milliseconds) of a fragment with `--record_fragmented`. "
+            "Fragments always begin on a keyframe, 0 writes one fragment per GOP.")
+        ("buffer_count", bpo::value<int>()->default_value(args.buffer_count),
+            "Number of capture buffers shared between the camera driver and the consumers. "
+            "Frames are dropped at capture when all of them are held by consumers.")
+        ("mjpeg_decode_threads", bpo::value<int>()->default_value(args.mjpeg_decode_threads),
+            "Number of threads decoding MJPEG frames in software, i.e. without `--hw_accel`. "
+            "Set to 0 to decode each frame where it is consumed.")
+        ("mjpeg_decode_depth", bpo::value<int>()->default_value(args.mjpeg_decode_depth),
+            "Maximum number of MJPEG frames waiting for or being decoded. Newer frames are "
+            "dropped while the decoders are that far behind.")
+        ("shm_name", bpo::value<std::string>()->default_value(args.shm_name),
+            "Export decoded frames as i420 into this POSIX shared memory ring for local "
+            "analytics, e.g. \"/pi_webrtc_frames\". Disabled when empty.")
+        ("shm_fps", bpo::value<int>()->default_value(args.shm_fps),
+            "Frame rate of the shared memory export, 0 exports every captured frame.")
+        ("shm_width", bpo::value<int>()->default_value(args.shm_width),
+            "Frame width of the shared memory export, 0 keeps the camera width.")
+        ("shm_height", bpo::value<int>()->default_value(args.shm_height),
+            "Frame height of the shared memory export, 0 keeps the camera height.")
+        ("shm_slots", bpo::value<int>()->default_value(args.shm_slots),
+            "Number of frames the shared memory ring holds before overwriting the oldest.")
         ("camera", bpo::value<std::string>()->default_value(args.camera),
             "Specify the camera using V4L2 or Libcamera. "
-            "Examples: \"libcamera:0\" for Libcamera, \"v4l2:0\" for V4L2 at `/dev/video0`.")
+            "Examples: \"libcamera:0\" for Libcamera, \"v4l2:0\" for V4L2 at `/dev/video0`, "
+            "\"file:/path/clip.y4m\" to replay a .y4m, .yuv (i420), .mjpeg or .h264 file at "
+            "`--fps`, \"file:testsrc\" for a test pattern. Raw files use `--width` and `--height`.")
         ("fixed_resolution", bpo::bool_switch()->default_value(args.fixed_resolution),
             "Disable adaptive resolution scaling and keep a fixed resolution.")
         ("no_audio", bpo::bool_switch()->default_value(args.no_audio), "Run without audio source")
@@ -75,8 +112,11 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
         ("use_websocket", bpo::bool_switch()->default_value(args.use_websocket),
             "Use websocket to exchange sdp and ice candidates")
         ("v4l2_format", bpo::value<std::string>()->default_value(args.v4l2_format),
-            "Set v4l2 camera capture format to `i420`, `mjpeg`, `h264`. The `h264` can pass "
-            "packets into mp4 without encoding to reduce cpu usage."
+            "Set v4l2 camera capture format to `i420`, `nv12`, `yuyv`, `uyvy`, `mjpeg`, `h264`. "
+            "Raw formats are handed to the hardware codecs as they are when `--hw_accel` is set. "
+            "The `h264` can pass "
+            "packets into mp4 without encoding to reduce cpu usage, and into WebRTC as well "
+            "when `--hw_accel` is set. "
             "Use `v4l2-ctl -d /dev/videoX --list-formats` can list available format");
     // clang-format on
 
@@ -97,10 +137,16 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
     SetIfExists(vm, "fps", args.fps);
     SetIfExists(vm, "width", args.width);
     SetIfExists(vm, "height", args.height);
+    SetIfExists(vm, "record_width", args.record_width);
+    SetIfExists(vm, "record_height", args.record_height);
     SetIfExists(vm, "jpeg_quality", args.jpeg_quality);
     SetIfExists(vm, "rotation_angle", args.rotation_angle);
     SetIfExists(vm, "peer_timeout", args.peer_timeout);
     SetIfExists(vm, "segment_duration", args.segment_duration);
+    SetIfExists(vm, "record_fragment_duration", args.record_fragment_duration);
+    SetIfExists(vm, "buffer_count", args.buffer_count);
+    SetIfExists(vm, "mjpeg_decode_threads", args.mjpeg_decode_threads);
+    SetIfExists(vm, "mjpeg_decode_depth", args.mjpeg_decode_depth);
     SetIfExists(vm, "camera", args.camera);
     SetIfExists(vm, "v4l2_format", args.v4l2_format);
     SetIfExists(vm, "uid", args.uid);
@@ -117,14 +163,51 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
     SetIfExists(vm, "ws_port", args.ws_port);
     SetIfExists(vm, "ws_token", args.ws_token);
     SetIfExists(vm, "record_path", args.record_path);
+    SetIfExists(vm, "shm_name", args.shm_name);
+    SetIfExists(vm, "shm_fps", args.shm_fps);
+    SetIfExists(vm, "shm_width", args.shm_width);
+    SetIfExists(vm, "shm_height", args.shm_height);
+    SetIfExists(vm, "shm_slots", args.shm_slots);
 
     args.fixed_resolution = vm["fixed_resolution"].as<bool>();
+    args.record_fragmented = vm["record_fragmented"].as<bool>();
     args.no_audio = vm["no_audio"].as<bool>();
     args.hw_accel = vm["hw_accel"].as<bool>();
     args.use_mqtt = vm["use_mqtt"].as<bool>();
     args.use_whep = vm["use_whep"].as<bool>();
     args.use_websocket = vm["use_websocket"].as<bool>();
 
+    if (args.buffer_count < 2) {
+        std::cout << "At least 2 capture buffers are required" << std::endl;
+        exit(1);
+    }
+
+    if (args.record_fragment_duration < 0) {
+        std::cout << "The record fragment duration can't be negative" << std::endl;
+        exit(1);
+    }
+
+    if ((args.record_width > 0) != (args.record_height > 0)) {
+        std::cout << "Both the record width and height are required" << std::endl;
+        exit(1);
+    }
+
+    if (args.mjpeg_decode_threads < 0 || args.mjpeg_decode_depth < 1) {
+        std::cout << "Invalid mjpeg decode threads or depth" << std::endl;
+        exit(1);
+    }
+
+    if (!args.shm_name.empty()) {
+        if (args.shm_name.front() != '/') {
+            args.shm_name = "/" + args.shm_name;
+        }
+        if (args.shm_fps < 0 || args.shm_width < 0 || args.shm_height < 0 ||
+            (args.shm_width > 0) != (args.shm_height > 0) || args.shm_slots < 2) {
+            std::cout << "Invalid shared memory export fps, size or slots" << std::endl;
+            exit(1);
+        }
+    }
+
     if (!args.stun_url.empty() && args.stun_url.substr(0, 4) != "stun") {
         std::cout << "Stun url should not be empty and start with \"stun:\"" << std::endl;
         exit(1);
@@ -148,6 +231,25 @@ void Parser::ParseArgs(int argc, char *argv[], Args &args) {
     ParseDevice(args);
 }
 
+uint32_t Parser::ParseFileFormat(const std::string &path) {
+    static const std::unordered_map<std::string, uint32_t> extension_map = {
+        {"y4m", V4L2_PIX_FMT_YUV420},  {"yuv", V4L2_PIX_FMT_YUV420}, {"i420", V4L2_PIX_FMT_YUV420},
+        {"mjpeg", V4L2_PIX_FMT_MJPEG}, {"mjpg", V4L2_PIX_FMT_MJPEG}, {"h264", V4L2_PIX_FMT_H264},
+        {"264", V4L2_PIX_FMT_H264},
+    };
+
+    if (path == "testsrc") {
+        return V4L2_PIX_FMT_YUV420;
+    }
+    size_t dot = path.rfind('.');
+    auto it = extension_map.find(dot == std::string::npos ? "" : path.substr(dot + 1));
+    if (it == extension_map.end()) {
+        std::cout << "Unsupported file type: " << path << std::endl;
+        exit(1);
+    }
+    return it->second;
+}
+
 void Parser::ParseDevice(Args &args) {
     size_t pos = args.camera.find(':');
     if (pos == std::string::npos) {
@@ -157,6 +259,14 @@ void Parser::ParseDevice(Args &args) {
     std::string prefix = args.camera.substr(0, pos);
     std::string id = args.camera.substr(pos + 1);
 
+    if (prefix == "file") {
+        args.use_file = true;
+        args.camera_file = id;
+        args.format = ParseFileFormat(id);
+        std::cout << "Using file: " << id << std::endl;
+        return;
+    }
+
     try {
         args.cameraId = std::stoi(id);
     } catch (const std::exception &e) {
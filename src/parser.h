@@ -7,6 +7,7 @@ class Parser {
   public:
     static void ParseArgs(int argc, char *argv[], Args &args);
     static void ParseDevice(Args &args);
+    static uint32_t ParseFileFormat(const std::string &path);
 };
 
 #endif // PARSER_H_
@@ -1,6 +1,8 @@
 #include "recorder/audio_recorder.h"
 #include "common/logging.h"
 
+#include <algorithm>
+
 std::unique_ptr<AudioRecorder> AudioRecorder::Create(Args config) {
     auto ptr = std::make_unique<AudioRecorder>(config);
     ptr->InitializeFifoBuffer();
@@ -28,6 +30,7 @@ void AudioRecorder::InitializeEncoderCtx(AVCodecContext *&encoder) {
     av_channel_layout_copy(&encoder->ch_layout, &channel_layout);
     encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
     avcodec_open2(encoder, codec, nullptr);
+    packet_time_base = encoder->time_base;
 
     InitializeFrame();
 }
@@ -46,16 +49,21 @@ void AudioRecorder::InitializeFrame() {
     av_frame_make_writable(frame);
 }
 
-void AudioRecorder::InitializeFifoBuffer() { fifo_buffer.alloc(sample_fmt, channels, 1); }
+void AudioRecorder::InitializeFifoBuffer() {
+    fifo_buffer.alloc(sample_fmt, channels, 1, sample_rate);
+}
 
 void AudioRecorder::Encode() {
-    if (fifo_buffer.read((void **)&frame->data, frame_size) < 0) {
+    int64_t timestamp_us;
+    if (fifo_buffer.read((void **)&frame->data, frame_size, &timestamp_us) <= 0) {
         DEBUG_PRINT("Failed to read audio data in fifo.");
         return;
     }
 
-    frame->pts = frame_count * frame->nb_samples;
-    frame_count++;
+    // The capture clock, shared with the video, so every file starts both streams in sync. Moving
+    // the anchor never takes the pts backwards.
+    frame->pts = std::max(av_rescale_q(timestamp_us, {1, 1000000}, encoder->time_base), next_pts);
+    next_pts = frame->pts + frame->nb_samples;
 
     int ret = avcodec_send_frame(encoder, frame);
     if (ret < 0 || ret == AVERROR_EOF) {
@@ -73,11 +81,6 @@ void AudioRecorder::Encode() {
             break;
         }
 
-        pkt->stream_index = st->index;
-        pkt->pts = av_rescale_q(pkt->pts, encoder->time_base, st->time_base);
-        pkt->dts = av_rescale_q(pkt->dts, encoder->time_base, st->time_base);
-        pkt->duration = av_rescale_q(pkt->duration, encoder->time_base, st->time_base);
-
         OnPacketed(pkt);
 
         av_packet_unref(pkt);
@@ -88,6 +91,13 @@ void AudioRecorder::Encode() {
 void AudioRecorder::OnBuffer(PaBuffer &buffer) {
     uint8_t **converted_input_samples = nullptr;
     int samples_per_channel = buffer.length / buffer.channels;
+    // The capturer hands the samples over as soon as the last one is in, the first one is as old
+    // as the buffer is long.
+    const int64_t timestamp_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count() -
+        av_rescale(samples_per_channel, 1000000, sample_rate);
 
     if (av_samples_alloc_array_and_samples(&converted_input_samples, nullptr, channels,
                                            samples_per_channel, sample_fmt, 0) < 0) {
@@ -104,8 +114,8 @@ void AudioRecorder::OnBuffer(PaBuffer &buffer) {
         }
     }
 
-    if (fifo_buffer.write(reinterpret_cast<void **>(converted_input_samples), samples_per_channel) <
-        samples_per_channel) {
+    if (fifo_buffer.write(reinterpret_cast<void **>(converted_input_samples), samples_per_channel,
+                          timestamp_us) < samples_per_channel) {
         DEBUG_PRINT("Failed to write audio date into fifo buffer.");
     }
 
@@ -117,8 +127,7 @@ void AudioRecorder::OnBuffer(PaBuffer &buffer) {
 }
 
 bool AudioRecorder::ConsumeBuffer() {
-    if (fifo_buffer.size() < frame_size) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (!fifo_buffer.wait_size(frame_size, std::chrono::milliseconds(100))) {
         return false;
     }
     Encode();
@@ -126,6 +135,6 @@ bool AudioRecorder::ConsumeBuffer() {
 }
 
 void AudioRecorder::PreStart() {
-    frame_count = 0;
+    next_pts = 0;
     fifo_buffer.reset();
 }
@@ -1,7 +1,9 @@
 #ifndef AUDIO_RECORDER_H_
 #define AUDIO_RECORDER_H_
 
+#include <chrono>
 #include <condition_variable>
+#include <cstdlib>
 #include <mutex>
 
 extern "C" {
@@ -14,25 +16,55 @@ extern "C" {
 #include "common/logging.h"
 #include "recorder/recorder.h"
 
+/* Also keeps the capture time of the samples, CLOCK_MONOTONIC like the video frames. Samples are
+ * counted from an anchor, which moves when the stamped writes drift away from the count. */
 class ThreadSafeAudioFifo {
   public:
-    void alloc(enum AVSampleFormat sample_fmt, int channels, int nb_samples) {
+    void alloc(enum AVSampleFormat sample_fmt, int channels, int nb_samples, int sample_rate) {
         fifo_ = av_audio_fifo_alloc(sample_fmt, channels, nb_samples);
         if (fifo_ == nullptr) {
             DEBUG_PRINT("Failed to initialize audio fifo buffer.");
         }
+        sample_rate_ = sample_rate;
+        anchor_us_ = 0;
+        anchor_samples_ = 0;
     }
 
-    int write(void **data, int nb_samples) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        return av_audio_fifo_write(fifo_, data, nb_samples);
+    // `timestamp_us` is the capture time of the first of the `nb_samples`.
+    int write(void **data, int nb_samples, int64_t timestamp_us) {
+        int written;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const int size = av_audio_fifo_size(fifo_);
+            const int64_t expected_us =
+                anchor_us_ + av_rescale(anchor_samples_ + size, 1000000, sample_rate_);
+            if (size == 0 || std::abs(timestamp_us - expected_us) > kMaxDriftUs) {
+                // Buffered samples keep their spacing, only the anchor moves.
+                anchor_us_ = timestamp_us - av_rescale(size, 1000000, sample_rate_);
+                anchor_samples_ = 0;
+            }
+            written = av_audio_fifo_write(fifo_, data, nb_samples);
+        }
+        cond_.notify_one();
+        return written;
     }
 
-    int read(void **data, int nb_samples) {
+    // Waits until at least `nb_samples` are buffered, returns false on timeout.
+    bool wait_size(int nb_samples, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cond_.wait_for(lock, timeout, [this, nb_samples]() {
+            return av_audio_fifo_size(fifo_) >= nb_samples;
+        });
+    }
+
+    // `timestamp_us` receives the capture time of the first sample read.
+    int read(void **data, int nb_samples, int64_t *timestamp_us) {
         std::lock_guard<std::mutex> lock(mutex_);
         if (av_audio_fifo_size(fifo_) < nb_samples) {
             return 0;
         }
+        *timestamp_us = anchor_us_ + av_rescale(anchor_samples_, 1000000, sample_rate_);
+        anchor_samples_ += nb_samples;
         return av_audio_fifo_read(fifo_, data, nb_samples);
     }
 
@@ -47,8 +79,15 @@ class ThreadSafeAudioFifo {
     }
 
   private:
+    // Beyond scheduling jitter, e.g. samples lost on the way or a drifting sound card clock.
+    static constexpr int64_t kMaxDriftUs = 40000;
+
     AVAudioFifo *fifo_;
+    int sample_rate_;
+    int64_t anchor_us_;      // capture time of the sample `anchor_samples_` before the head
+    int64_t anchor_samples_; // samples read since the anchor
     std::mutex mutex_;
+    std::condition_variable cond_;
 };
 
 class AudioRecorder : public Recorder<PaBuffer> {
@@ -63,7 +102,7 @@ class AudioRecorder : public Recorder<PaBuffer> {
     int sample_rate;
     int channels = 2;
     int frame_size;
-    unsigned int frame_count;
+    int64_t next_pts;
     std::string encoder_name;
     ThreadSafeAudioFifo fifo_buffer;
     AVSampleFormat sample_fmt;
@@ -1,11 +1,16 @@
 #include "recorder/h264_recorder.h"
+#include "common/logging.h"
 
 std::unique_ptr<H264Recorder> H264Recorder::Create(Args config) {
     return std::make_unique<H264Recorder>(config, "h264_v4l2m2m");
 }
 
 H264Recorder::H264Recorder(Args config, std::string encoder_name)
-    : VideoRecorder(config, encoder_name) {}
+    : VideoRecorder(config, encoder_name),
+      src_pix_fmt_(V4L2Encoder::IsSupportedSourceFormat(config.format) ? config.format
+                                                                        : V4L2_PIX_FMT_YUV420),
+      encoder_stride_(0),
+      is_keyframe_requested_(false) {}
 
 H264Recorder::~H264Recorder() {
     encoder_.reset();
@@ -18,21 +23,46 @@ void H264Recorder::Encode(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
         return;
     }
 
-    auto i420_buffer = frame_buffer->ToI420();
     if (config.hw_accel) {
-        unsigned int i420_buffer_size =
-            (i420_buffer->StrideY() * frame_buffer->height()) +
-            ((i420_buffer->StrideY() + 1) / 2) * ((frame_buffer->height() + 1) / 2) * 2;
+        V4L2Buffer decoded_buffer;
+        int src_stride;
+        // Holds the converted picture until the encoder has taken it.
+        rtc::scoped_refptr<webrtc::I420BufferInterface> i420_buffer;
+        if (frame_buffer->format() == src_pix_fmt_) {
+            // Already in the layout the encoder was opened with, e.g. NV12 from the camera.
+            decoded_buffer = frame_buffer->GetRawBuffer();
+            src_stride = frame_buffer->stride();
+        } else {
+            i420_buffer = frame_buffer->ToI420();
+            unsigned int i420_buffer_size =
+                (i420_buffer->StrideY() * frame_buffer->height()) +
+                ((i420_buffer->StrideY() + 1) / 2) * ((frame_buffer->height() + 1) / 2) * 2;
+            decoded_buffer = V4L2Buffer((void *)i420_buffer->DataY(), i420_buffer_size);
+            src_stride = i420_buffer->StrideY();
+        }
 
-        V4L2Buffer decoded_buffer((void *)i420_buffer->DataY(), i420_buffer_size);
+        src_stride = src_stride == frame_buffer->width() ? 0 : src_stride;
+        if (src_stride != encoder_stride_) {
+            DEBUG_PRINT("Recreate the recording encoder for stride %d", src_stride);
+            InitHwEncoder(src_stride);
+        }
 
+        if (is_keyframe_requested_.exchange(false)) {
+            V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
+        }
         encoder_->EmplaceBuffer(decoded_buffer, [this, frame_buffer](V4L2Buffer encoded_buffer) {
             encoded_buffer.timestamp = frame_buffer->timestamp();
             OnEncoded(encoded_buffer);
         });
     } else {
-        sw_encoder_->Encode(i420_buffer, [this, frame_buffer](uint8_t *encoded_buffer, int size) {
-            V4L2Buffer buffer((void *)encoded_buffer, size, frame_buffer->flags(),
+        auto i420_buffer = frame_buffer->ToI420();
+        if (is_keyframe_requested_.exchange(false)) {
+            sw_encoder_->ForceKeyFrame();
+        }
+        sw_encoder_->Encode(i420_buffer, [this, frame_buffer](uint8_t *encoded_buffer, int size,
+                                                              bool is_keyframe) {
+            V4L2Buffer buffer((void *)encoded_buffer, size,
+                              is_keyframe ? V4L2_BUF_FLAG_KEYFRAME : V4L2_BUF_FLAG_PFRAME,
                               frame_buffer->timestamp());
             OnEncoded(buffer);
         });
@@ -41,6 +71,8 @@ void H264Recorder::Encode(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
 
 void H264Recorder::PreStart() { InitCodecs(); }
 
+void H264Recorder::RequestKeyFrame() { is_keyframe_requested_ = true; }
+
 void H264Recorder::PostStop() {
     std::lock_guard<std::mutex> lock(mutex_);
     abort = true;
@@ -52,16 +84,24 @@ void H264Recorder::InitCodecs() {
     std::lock_guard<std::mutex> lock(mutex_);
 
     if (config.hw_accel) {
-        encoder_ = V4L2Encoder::Create(config.width, config.height, false);
-        encoder_->SetFps(config.fps);
-        encoder_->SetBitrate(config.width * config.height * config.fps * 0.1);
-        V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_BITRATE_MODE,
-                             V4L2_MPEG_VIDEO_BITRATE_MODE_VBR);
-        V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_H264_LEVEL,
-                             V4L2_MPEG_VIDEO_H264_LEVEL_4_0);
-        V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
-        V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, 60);
+        InitHwEncoder(encoder_stride_);
     } else {
         sw_encoder_ = Openh264Encoder::Create(config);
     }
 }
+
+void H264Recorder::InitHwEncoder(int src_stride) {
+    encoder_stride_ = src_stride;
+    encoder_.reset();
+    encoder_ = V4L2Encoder::Create(config.width, config.height, false, src_pix_fmt_, src_stride);
+    // The recorder thread may wait for the encoder, its frame queue absorbs the delay.
+    encoder_->SetBackpressure(V4L2Codec::Backpressure::Block);
+    encoder_->SetFps(config.fps);
+    encoder_->SetBitrate(config.width * config.height * config.fps * 0.1);
+    V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_BITRATE_MODE,
+                         V4L2_MPEG_VIDEO_BITRATE_MODE_VBR);
+    V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_H264_LEVEL,
+                         V4L2_MPEG_VIDEO_H264_LEVEL_4_0);
+    V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_FORCE_KEY_FRAME, 1);
+    V4L2Util::SetExtCtrl(encoder_->GetFd(), V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, 60);
+}
@@ -15,17 +15,24 @@ class H264Recorder : public VideoRecorder {
     ~H264Recorder();
     void PreStart() override;
     void PostStop() override;
+    void RequestKeyFrame() override;
 
   protected:
     void Encode(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) override;
 
   private:
     std::mutex mutex_;
+    // Frames in this format skip the I420 conversion.
+    const uint32_t src_pix_fmt_;
+    // Bytes per row the encoder was opened with, 0 when rows are packed.
+    int encoder_stride_;
+    std::atomic<bool> is_keyframe_requested_;
     std::unique_ptr<V4L2Decoder> decoder_;
     std::unique_ptr<V4L2Encoder> encoder_;
     std::unique_ptr<Openh264Encoder> sw_encoder_;
 
     void InitCodecs();
+    void InitHwEncoder(int src_stride);
 };
 
 #endif // H264_RECORDER_H_
@@ -28,8 +28,9 @@ void RawH264Recorder::PreStart() {
 void RawH264Recorder::PostStop() {
     // Wait P-frames are all consumed until I-frame appear.
     auto frame = frame_buffer_queue.front();
-    while (frame && (frame.value()->flags() & V4L2_BUF_FLAG_KEYFRAME) != 0) {
+    while (frame && ((*frame)->flags() & V4L2_BUF_FLAG_KEYFRAME) == 0) {
         ConsumeBuffer();
+        frame = frame_buffer_queue.front();
     }
     abort = true;
 }
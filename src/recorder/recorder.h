@@ -16,32 +16,44 @@ template <typename T> class Recorder {
   public:
     using OnPacketedFunc = std::function<void(AVPacket *pkt)>;
 
-    Recorder() = default;
-    ~Recorder() { Stop(); };
+    Recorder()
+        : encoder(nullptr),
+          codecpar(avcodec_parameters_alloc()),
+          packet_time_base({0, 1}) {}
+    ~Recorder() {
+        Stop();
+        avcodec_free_context(&encoder);
+        avcodec_parameters_free(&codecpar);
+    };
 
     virtual void OnBuffer(T &buffer) = 0;
 
     virtual void PostStop(){};
     virtual void PreStart(){};
 
-    bool AddStream(AVFormatContext *output_fmt_ctx) {
-        avcodec_free_context(&encoder);
-        InitializeEncoderCtx(encoder);
-        st = avformat_new_stream(output_fmt_ctx, encoder->codec);
-        avcodec_parameters_from_context(st->codecpar, encoder);
-
-        return st != nullptr;
+    /* Adds a stream for this recorder's packets. The encoder is set up only once, later containers
+     * copy its parameters, so a new file can be opened while the recorder runs. */
+    AVStream *AddStream(AVFormatContext *output_fmt_ctx) {
+        InitializeEncoder();
+        AVStream *st = avformat_new_stream(output_fmt_ctx, nullptr);
+        if (st) {
+            avcodec_parameters_copy(st->codecpar, codecpar);
+        }
+        return st;
     }
 
+    // Packets keep this time base across files, the muxer rescales them for each container.
+    AVRational time_base() const { return packet_time_base; }
+
     void OnPacketed(OnPacketedFunc fn) { on_packeted = fn; }
 
     void Stop() {
         worker.reset();
-        avcodec_free_context(&encoder);
         PostStop();
     }
 
     void Start() {
+        InitializeEncoder();
         worker = std::make_unique<Worker>("Recorder", [this]() {
             ConsumeBuffer();
         });
@@ -53,9 +65,16 @@ template <typename T> class Recorder {
     OnPacketedFunc on_packeted;
     std::unique_ptr<Worker> worker;
     AVCodecContext *encoder;
-    AVStream *st;
+    AVCodecParameters *codecpar;
+    AVRational packet_time_base;
 
     virtual void InitializeEncoderCtx(AVCodecContext *&encoder) = 0;
+    void InitializeEncoder() {
+        if (!encoder) {
+            InitializeEncoderCtx(encoder);
+            avcodec_parameters_from_context(codecpar, encoder);
+        }
+    }
     virtual bool ConsumeBuffer() = 0;
     void OnPacketed(AVPacket *pkt) {
         if (on_packeted) {
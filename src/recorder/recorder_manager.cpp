@@ -1,11 +1,8 @@
 #include "recorder/recorder_manager.h"
 
 #include <chrono>
-#include <condition_variable>
 #include <csignal>
 #include <filesystem>
-#include <future>
-#include <mutex>
 #include <thread>
 
 #include "common/logging.h"
@@ -14,10 +11,14 @@
 #include "recorder/h264_recorder.h"
 #include "recorder/raw_h264_recorder.h"
 
-const double SECOND_PER_FILE = 60.0;
 const unsigned long MIN_FREE_BYTE = 400 * 1024 * 1024;
 const char *CONTAINER_FORMAT = "mp4";
 const char *PREVIEW_IMAGE_EXTENSION = ".jpg";
+// A few seconds of packets, the mux thread may be busy opening a file meanwhile.
+static const int kPacketQueueCapacity = 512;
+static const std::chrono::milliseconds kMuxTimeout(100);
+// How long before the boundary the next file is opened.
+static const int64_t kOpenAheadUs = 2000000;
 
 AVFormatContext *RecUtil::CreateContainer(const std::string &full_path) {
     AVFormatContext *fmt_ctx = nullptr;
@@ -38,8 +39,8 @@ AVFormatContext *RecUtil::CreateContainer(const std::string &full_path) {
     return fmt_ctx;
 }
 
-bool RecUtil::WriteFormatHeader(AVFormatContext *fmt_ctx) {
-    if (avformat_write_header(fmt_ctx, nullptr) < 0) {
+bool RecUtil::WriteFormatHeader(AVFormatContext *fmt_ctx, AVDictionary **options) {
+    if (avformat_write_header(fmt_ctx, options) < 0) {
         ERROR_PRINT("Error occurred when opening output file");
         return false;
     }
@@ -67,20 +68,27 @@ std::unique_ptr<RecorderManager> RecorderManager::Create(std::shared_ptr<VideoCa
         instance->CreateAudioRecorder(audio_src);
         instance->SubscribeAudioSource(audio_src);
     }
+    instance->Start();
 
     return instance;
 }
 
 void RecorderManager::CreateVideoRecorder(std::shared_ptr<VideoCapturer> capturer) {
     video_src_ = capturer;
+    jpeg_encoder_ = JpegEncoder::Acquire();
     fps = capturer->fps();
-    width = capturer->width();
-    height = capturer->height();
-    video_recorder = ([capturer]() -> std::unique_ptr<VideoRecorder> {
+    width = capturer->record_width();
+    height = capturer->record_height();
+
+    // Recordings may come from a larger stream than the one WebRTC gets.
+    Args record_config = capturer->config();
+    record_config.width = width;
+    record_config.height = height;
+    video_recorder = ([capturer, record_config]() -> std::unique_ptr<VideoRecorder> {
         if (capturer->format() == V4L2_PIX_FMT_H264) {
-            return RawH264Recorder::Create(capturer->config());
+            return RawH264Recorder::Create(record_config);
         } else {
-            return H264Recorder::Create(capturer->config());
+            return H264Recorder::Create(record_config);
         }
     })();
 }
@@ -93,94 +101,45 @@ void RecorderManager::CreateAudioRecorder(std::shared_ptr<PaCapturer> capturer)
 
 RecorderManager::RecorderManager(Args config)
     : config(config),
-      fmt_ctx(nullptr),
-      has_first_keyframe(false),
       record_path(config.record_path),
-      elapsed_time_(0.0) {}
+      packet_queue_(kPacketQueueCapacity),
+      video_stream_(-1),
+      audio_stream_(-1),
+      fmt_ctx_(nullptr),
+      next_fmt_ctx_(nullptr),
+      segment_start_us_(AV_NOPTS_VALUE),
+      is_keyframe_requested_(false) {}
 
 void RecorderManager::SubscribeVideoSource(std::shared_ptr<VideoCapturer> video_src) {
-    video_observer = video_src->AsRawBufferObservable();
+    video_observer = video_src->AsRecordBufferObservable();
     video_observer->Subscribe([this](V4L2Buffer buffer) {
-        // waiting first keyframe to start recorders.
-        if (!has_first_keyframe && ((buffer.flags & V4L2_BUF_FLAG_KEYFRAME) ||
-                                    video_src_->format() != V4L2_PIX_FMT_H264)) {
-            Start();
-            last_created_time_ = buffer.timestamp;
-        }
-
-        // restart to write in the new file.
-        if (elapsed_time_ >= config.segment_duration && buffer.flags & V4L2_BUF_FLAG_KEYFRAME) {
-            last_created_time_ = buffer.timestamp;
-            Stop();
-            Start();
-        }
-
-        if (has_first_keyframe && video_recorder) {
-            video_recorder->OnBuffer(buffer);
-            elapsed_time_ = (buffer.timestamp.tv_sec - last_created_time_.tv_sec) +
-                            (buffer.timestamp.tv_usec - last_created_time_.tv_usec) / 1000000.0;
-        }
+        // Only a copy into the recorder's queue, files are switched on the mux thread.
+        video_recorder->OnBuffer(buffer);
     });
 
     video_recorder->OnPacketed([this](AVPacket *pkt) {
-        this->WriteIntoFile(pkt);
+        QueuePacket(pkt, video_stream_);
     });
 }
 
 void RecorderManager::SubscribeAudioSource(std::shared_ptr<PaCapturer> audio_src) {
     audio_observer = audio_src->AsObservable();
     audio_observer->Subscribe([this](PaBuffer buffer) {
-        if (has_first_keyframe && audio_recorder) {
-            audio_recorder->OnBuffer(buffer);
-        }
+        // Packets before the first keyframe are dropped by the mux thread.
+        audio_recorder->OnBuffer(buffer);
     });
 
     audio_recorder->OnPacketed([this](AVPacket *pkt) {
-        this->WriteIntoFile(pkt);
+        QueuePacket(pkt, audio_stream_);
     });
 }
 
-void RecorderManager::WriteIntoFile(AVPacket *pkt) {
-    std::lock_guard<std::mutex> lock(ctx_mux);
-    int ret;
-    if (fmt_ctx && fmt_ctx->nb_streams > pkt->stream_index &&
-        (ret = av_interleaved_write_frame(fmt_ctx, pkt)) < 0) {
-        char err_buf[AV_ERROR_MAX_STRING_SIZE];
-        av_strerror(ret, err_buf, sizeof(err_buf));
-        fprintf(stderr, "Error occurred: %s\n", err_buf);
-    }
-}
-
 void RecorderManager::Start() {
-    if (!Utils::CheckDriveSpace(record_path, MIN_FREE_BYTE)) {
-        auto task = std::async(std::launch::async, [this]() {
-            Utils::RotateFiles(record_path);
-        });
-    }
-
-    FileInfo new_file(record_path, CONTAINER_FORMAT);
-    auto folder = new_file.GetFolderPath();
-    Utils::CreateFolder(folder);
-
-    {
-        std::lock_guard<std::mutex> lock(ctx_mux);
-        fmt_ctx = RecUtil::CreateContainer(new_file.GetFullPath());
-        if (fmt_ctx == nullptr) {
-            usleep(1000);
-            return;
-        }
-
-        if (video_recorder) {
-            video_recorder->AddStream(fmt_ctx);
-        }
-        if (audio_recorder) {
-            audio_recorder->AddStream(fmt_ctx);
-        }
-
-        RecUtil::WriteFormatHeader(fmt_ctx);
-
-        av_dump_format(fmt_ctx, 0, new_file.GetFullPath().c_str(), 1);
-    }
+    // Every file adds its streams in this order.
+    video_stream_ = video_recorder ? 0 : -1;
+    audio_stream_ = audio_recorder ? video_stream_ + 1 : -1;
+    next_fmt_ctx_ = OpenFile();
+    packet_queue_.reset();
 
     if (video_recorder) {
         video_recorder->Start();
@@ -189,9 +148,10 @@ void RecorderManager::Start() {
         audio_recorder->Start();
     }
 
-    MakePreviewImage();
-
-    has_first_keyframe = true;
+    mux_worker_ = std::make_unique<Worker>("Muxer", [this]() {
+        MuxPacket();
+    });
+    mux_worker_->Run();
 }
 
 void RecorderManager::Stop() {
@@ -201,12 +161,28 @@ void RecorderManager::Stop() {
     if (audio_recorder) {
         audio_recorder->Stop();
     }
+    mux_worker_.reset();
 
-    if (fmt_ctx) {
-        std::lock_guard<std::mutex> lock(ctx_mux);
-        RecUtil::CloseContext(fmt_ctx);
-        fmt_ctx = nullptr;
+    // The recorders are done, what they left in the queue still belongs to the current file.
+    packet_queue_.shutdown();
+    while (auto pkt = packet_queue_.try_pop()) {
+        WriteIntoFile(pkt.value());
+        av_packet_free(&pkt.value());
+    }
+
+    if (closing_.valid()) {
+        closing_.wait();
+    }
+    RecUtil::CloseContext(fmt_ctx_);
+    fmt_ctx_ = nullptr;
+    if (next_fmt_ctx_) {
+        // Opened ahead of a segment that never came.
+        std::string path = next_fmt_ctx_->url;
+        RecUtil::CloseContext(next_fmt_ctx_);
+        next_fmt_ctx_ = nullptr;
+        std::filesystem::remove(path);
     }
+    segment_start_us_ = AV_NOPTS_VALUE;
 }
 
 RecorderManager::~RecorderManager() {
@@ -218,16 +194,186 @@ RecorderManager::~RecorderManager() {
     audio_observer.reset();
 }
 
-void RecorderManager::MakePreviewImage() {
-    std::thread([this]() {
+void RecorderManager::QueuePacket(AVPacket *pkt, int stream_index) {
+    // The recorder reuses the packet's memory, the clone copies it.
+    AVPacket *queued = av_packet_clone(pkt);
+    if (!queued) {
+        return;
+    }
+    queued->stream_index = stream_index;
+    if (!packet_queue_.push(queued)) {
+        DEBUG_PRINT("The mux queue is full, a packet of stream %d is dropped.", stream_index);
+        av_packet_free(&queued);
+    }
+}
+
+void RecorderManager::MuxPacket() {
+    auto item = packet_queue_.wait_pop(kMuxTimeout);
+    if (!item) {
+        return;
+    }
+    AVPacket *pkt = item.value();
+
+    const int64_t pts_us =
+        av_rescale_q(pkt->pts, SourceTimeBase(pkt->stream_index), AV_TIME_BASE_Q);
+    const bool is_cut_point =
+        video_recorder ? pkt->stream_index == video_stream_ && (pkt->flags & AV_PKT_FLAG_KEY)
+                       : true;
+    const int64_t segment_us = config.segment_duration * 1000000LL;
+
+    if (segment_start_us_ == AV_NOPTS_VALUE) {
+        // Recording begins on the first keyframe.
+        if (is_cut_point) {
+            SwitchFile(pts_us);
+        }
+    } else {
+        const int64_t elapsed_us = pts_us - segment_start_us_;
+        if (elapsed_us >= segment_us && is_cut_point) {
+            SwitchFile(pts_us);
+        } else if (elapsed_us >= segment_us && !is_keyframe_requested_) {
+            is_keyframe_requested_ = true;
+            if (video_recorder) {
+                video_recorder->RequestKeyFrame();
+            }
+            if (video_src_) {
+                video_src_->RequestKeyFrame();
+            }
+        } else if (elapsed_us >= segment_us - kOpenAheadUs && !next_fmt_ctx_) {
+            next_fmt_ctx_ = OpenFile();
+        }
+    }
+
+    if (segment_start_us_ != AV_NOPTS_VALUE) {
+        WriteIntoFile(pkt);
+    }
+    av_packet_free(&pkt);
+}
+
+void RecorderManager::WriteIntoFile(AVPacket *pkt) {
+    if (!fmt_ctx_ || pkt->stream_index < 0 || (int)fmt_ctx_->nb_streams <= pkt->stream_index) {
+        return;
+    }
+
+    // Both recorders stamp packets with the capture clock, so every file starts all its streams
+    // from zero at its first keyframe. Rounding down never cuts off the keyframe itself.
+    const int64_t start_pts =
+        av_rescale_q_rnd(segment_start_us_, AV_TIME_BASE_Q, SourceTimeBase(pkt->stream_index),
+                         AV_ROUND_DOWN);
+    if (pkt->pts < start_pts) {
+        return;
+    }
+    pkt->pts -= start_pts;
+    pkt->dts -= start_pts;
+    av_packet_rescale_ts(pkt, SourceTimeBase(pkt->stream_index),
+                         fmt_ctx_->streams[pkt->stream_index]->time_base);
+
+    int ret = av_interleaved_write_frame(fmt_ctx_, pkt);
+    if (ret < 0) {
+        char err_buf[AV_ERROR_MAX_STRING_SIZE];
+        av_strerror(ret, err_buf, sizeof(err_buf));
+        fprintf(stderr, "Error occurred: %s\n", err_buf);
+    }
+}
+
+void RecorderManager::SwitchFile(int64_t start_us) {
+    if (!next_fmt_ctx_) {
+        // Opening ahead failed or the segment was too short for it.
+        next_fmt_ctx_ = OpenFile();
+    }
+    if (!next_fmt_ctx_) {
+        // Keep the current file and try again on the next keyframe.
+        return;
+    }
+
+    CloseFileInBackground(fmt_ctx_);
+    fmt_ctx_ = next_fmt_ctx_;
+    next_fmt_ctx_ = nullptr;
+    segment_start_us_ = start_us;
+    is_keyframe_requested_ = false;
+
+    MakePreviewImage(fmt_ctx_->url);
+}
+
+AVFormatContext *RecorderManager::OpenFile() {
+    if (!Utils::CheckDriveSpace(record_path, MIN_FREE_BYTE)) {
+        Utils::RotateFiles(record_path);
+    }
+
+    FileInfo new_file(record_path, CONTAINER_FORMAT);
+    Utils::CreateFolder(new_file.GetFolderPath());
+
+    AVFormatContext *fmt_ctx = RecUtil::CreateContainer(new_file.GetFullPath());
+    if (fmt_ctx == nullptr) {
+        return nullptr;
+    }
+
+    bool is_ready = true;
+    if (video_recorder) {
+        is_ready = video_recorder->AddStream(fmt_ctx) != nullptr;
+    }
+    if (audio_recorder && is_ready) {
+        is_ready = audio_recorder->AddStream(fmt_ctx) != nullptr;
+    }
+
+    AVDictionary *options = nullptr;
+    if (config.record_fragmented) {
+        // An empty moov, then a moof per fragment, so the sample tables never pile up in memory
+        // and a crash only loses the fragment being written. The moov waits for the first
+        // fragment, the SPS and PPS only arrive with the first keyframe.
+        av_dict_set(&options, "movflags",
+                    "frag_keyframe+empty_moov+delay_moov+default_base_moof", 0);
+        if (config.record_fragment_duration > 0) {
+            av_dict_set_int(&options, "min_frag_duration",
+                            config.record_fragment_duration * 1000LL, 0);
+        }
+    }
+    is_ready = is_ready && RecUtil::WriteFormatHeader(fmt_ctx, &options);
+    av_dict_free(&options);
+
+    if (!is_ready) {
+        avio_closep(&fmt_ctx->pb);
+        avformat_free_context(fmt_ctx);
+        std::filesystem::remove(new_file.GetFullPath());
+        return nullptr;
+    }
+
+    av_dump_format(fmt_ctx, 0, new_file.GetFullPath().c_str(), 1);
+    return fmt_ctx;
+}
+
+void RecorderManager::CloseFileInBackground(AVFormatContext *fmt_ctx) {
+    if (!fmt_ctx) {
+        return;
+    }
+    // Writing the moov box reads back the whole index, segments are far enough apart that the
+    // previous one has long finished.
+    if (closing_.valid()) {
+        closing_.wait();
+    }
+    closing_ = std::async(std::launch::async, [fmt_ctx]() {
+        RecUtil::CloseContext(fmt_ctx);
+    });
+}
+
+AVRational RecorderManager::SourceTimeBase(int stream_index) const {
+    if (stream_index == video_stream_) {
+        return video_recorder->time_base();
+    }
+    return audio_recorder->time_base();
+}
+
+void RecorderManager::MakePreviewImage(const std::string &path) {
+    std::thread([this, path]() {
         std::this_thread::sleep_for(std::chrono::seconds(3));
         if (video_src_ == nullptr) {
             return;
         }
         auto i420buff = video_src_->GetI420Frame();
-        Utils::CreateJpegImage(i420buff->DataY(), i420buff->width(), i420buff->height(),
-                               ReplaceExtension(fmt_ctx->url, PREVIEW_IMAGE_EXTENSION),
-                               config.jpeg_quality);
+        if (!i420buff) {
+            return;
+        }
+        Utils::WriteJpegImage(jpeg_encoder_->Encode(i420buff, config.jpeg_quality),
+                              ReplaceExtension(path, PREVIEW_IMAGE_EXTENSION));
     }).detach();
 }
 
@@ -1,7 +1,7 @@
 #ifndef RECORDER_MANAGER_H_
 #define RECORDER_MANAGER_H_
 
-#include <mutex>
+#include <future>
 
 extern "C" {
 #include <libavcodec/avcodec.h>
@@ -12,6 +12,8 @@ extern "C" {
 
 #include "capturer/pa_capturer.h"
 #include "capturer/video_capturer.h"
+#include "codecs/jpeg/jpeg_encoder.h"
+#include "common/bounded_queue.h"
 #include "common/worker.h"
 #include "recorder/audio_recorder.h"
 #include "recorder/video_recorder.h"
@@ -19,10 +21,14 @@ extern "C" {
 class RecUtil {
   public:
     static AVFormatContext *CreateContainer(const std::string &full_path);
-    static bool WriteFormatHeader(AVFormatContext *fmt_ctx);
+    static bool WriteFormatHeader(AVFormatContext *fmt_ctx, AVDictionary **options = nullptr);
     static void CloseContext(AVFormatContext *fmt_ctx);
 };
 
+/* Encoders run for the whole recording and hand their packets to a mux thread, which owns the
+ * files. It opens the next file shortly before the segment ends, switches to it on the first
+ * keyframe past the boundary and writes the old file's trailer in the background, so the capture
+ * thread never waits for the disk. */
 class RecorderManager {
   public:
     static std::unique_ptr<RecorderManager> Create(std::shared_ptr<VideoCapturer> video_src,
@@ -30,19 +36,15 @@ class RecorderManager {
                                                    Args config);
     RecorderManager(Args config);
     ~RecorderManager();
-    void WriteIntoFile(AVPacket *pkt);
     void Start();
     void Stop();
 
   protected:
-    std::mutex ctx_mux;
     Args config;
     uint fps;
     int width;
     int height;
     std::string record_path;
-    AVFormatContext *fmt_ctx;
-    bool has_first_keyframe;
     std::shared_ptr<Observable<V4L2Buffer>> video_observer;
     std::shared_ptr<Observable<PaBuffer>> audio_observer;
     std::unique_ptr<VideoRecorder> video_recorder;
@@ -54,11 +56,28 @@ class RecorderManager {
     void SubscribeAudioSource(std::shared_ptr<PaCapturer> aduio_src);
 
   private:
-    double elapsed_time_;
-    struct timeval last_created_time_;
     std::shared_ptr<VideoCapturer> video_src_;
+    std::shared_ptr<JpegEncoder> jpeg_encoder_;
+    BoundedQueue<AVPacket *> packet_queue_;
+    std::unique_ptr<Worker> mux_worker_;
+    int video_stream_;
+    int audio_stream_;
+    // Only the mux thread touches these once recording has started.
+    AVFormatContext *fmt_ctx_;
+    AVFormatContext *next_fmt_ctx_;
+    // The switching keyframe's time, every stream of the file starts from it.
+    int64_t segment_start_us_;
+    bool is_keyframe_requested_;
+    std::future<void> closing_;
 
-    void MakePreviewImage();
+    void QueuePacket(AVPacket *pkt, int stream_index);
+    void MuxPacket();
+    void WriteIntoFile(AVPacket *pkt);
+    void SwitchFile(int64_t start_us);
+    AVFormatContext *OpenFile();
+    void CloseFileInBackground(AVFormatContext *fmt_ctx);
+    AVRational SourceTimeBase(int stream_index) const;
+    void MakePreviewImage(const std::string &path);
     std::string ReplaceExtension(const std::string &url, const std::string &new_extension);
 };
 
@@ -6,11 +6,16 @@
 #include "recorder/h264_recorder.h"
 #include "recorder/raw_h264_recorder.h"
 
+static const int kFrameQueueCapacity = 8;
+static const std::chrono::milliseconds kConsumeTimeout(100);
+
 VideoRecorder::VideoRecorder(Args config, std::string encoder_name)
     : Recorder(),
       encoder_name(encoder_name),
       config(config),
-      abort(true) {}
+      abort(true),
+      frame_buffer_queue(kFrameQueueCapacity),
+      frame_buffer_pool(FrameBufferPool::Create(kFrameQueueCapacity + 1)) {}
 
 void VideoRecorder::InitializeEncoderCtx(AVCodecContext *&encoder) {
     frame_rate = {.num = (int)config.fps, .den = 1};
@@ -23,31 +28,28 @@ void VideoRecorder::InitializeEncoderCtx(AVCodecContext *&encoder) {
     encoder->framerate = frame_rate;
     encoder->time_base = av_inv_q(frame_rate);
     encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    packet_time_base = {1, 1000000};
 }
 
 void VideoRecorder::OnBuffer(V4L2Buffer &buffer) {
-    if (frame_buffer_queue.size() < 8) {
-        rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer(
-            V4L2FrameBuffer::Create(config.width, config.height, buffer, config.format));
+    if (frame_buffer_queue.size() < frame_buffer_queue.capacity()) {
+        rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer(V4L2FrameBuffer::Create(
+            config.width, config.height, buffer, config.format, nullptr, frame_buffer_pool));
         frame_buffer->CopyBufferData();
-        frame_buffer_queue.push(frame_buffer);
+        frame_buffer_queue.push(std::move(frame_buffer));
     }
 }
 
 void VideoRecorder::PostStop() { abort = true; }
 
-void VideoRecorder::SetBaseTimestamp(struct timeval time) { base_time_ = time; }
-
 void VideoRecorder::OnEncoded(V4L2Buffer &buffer) {
     AVPacket *pkt = av_packet_alloc();
     pkt->data = static_cast<uint8_t *>(buffer.start);
     pkt->size = buffer.length;
-    pkt->stream_index = st->index;
-
-    double elapsed_time = (buffer.timestamp.tv_sec - base_time_.tv_sec) +
-                          (buffer.timestamp.tv_usec - base_time_.tv_usec) / 1000000.0;
-    pkt->pts = pkt->dts =
-        static_cast<int64_t>(elapsed_time * st->time_base.den / st->time_base.num);
+    pkt->pts = pkt->dts = buffer.timestamp.tv_sec * 1000000LL + buffer.timestamp.tv_usec;
+    if (buffer.flags & V4L2_BUF_FLAG_KEYFRAME) {
+        pkt->flags |= AV_PKT_FLAG_KEY;
+    }
 
     OnPacketed(pkt);
     av_packet_unref(pkt);
@@ -55,10 +57,8 @@ void VideoRecorder::OnEncoded(V4L2Buffer &buffer) {
 }
 
 bool VideoRecorder::ConsumeBuffer() {
-    auto item = frame_buffer_queue.pop();
-
+    auto item = frame_buffer_queue.wait_pop(kConsumeTimeout);
     if (!item) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(20));
         return false;
     }
 
@@ -66,7 +66,6 @@ bool VideoRecorder::ConsumeBuffer() {
 
     if (abort.load() && (frame_buffer->flags() & V4L2_BUF_FLAG_KEYFRAME)) {
         abort.store(false);
-        SetBaseTimestamp(frame_buffer->timestamp());
     }
 
     if (!abort.load()) {
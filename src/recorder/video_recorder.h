@@ -10,7 +10,8 @@ extern "C" {
 
 #include "args.h"
 #include "codecs/v4l2/v4l2_decoder.h"
-#include "common/thread_safe_queue.h"
+#include "common/bounded_queue.h"
+#include "common/frame_buffer_pool.h"
 #include "common/v4l2_frame_buffer.h"
 #include "recorder/recorder.h"
 
@@ -20,23 +21,26 @@ class VideoRecorder : public Recorder<V4L2Buffer> {
     virtual ~VideoRecorder(){};
     void OnBuffer(V4L2Buffer &buffer) override;
     void PostStop() override;
+    // Asks the encoder for an IDR frame, so a new file can begin soon.
+    virtual void RequestKeyFrame(){};
 
   protected:
     Args config;
     std::atomic<bool> abort;
     std::string encoder_name;
-    ThreadSafeQueue<rtc::scoped_refptr<V4L2FrameBuffer>> frame_buffer_queue;
+    // Filled by the capture thread, drained by the recorder worker.
+    SpscQueue<rtc::scoped_refptr<V4L2FrameBuffer>> frame_buffer_queue;
+    std::shared_ptr<FrameBufferPool> frame_buffer_pool;
 
     AVRational frame_rate;
 
     virtual void Encode(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) = 0;
 
     bool ConsumeBuffer() override;
+    // Stamps the packet with the frame's capture time, CLOCK_MONOTONIC like the audio.
     void OnEncoded(V4L2Buffer &buffer);
-    void SetBaseTimestamp(struct timeval time);
 
   private:
-    struct timeval base_time_;
     std::unique_ptr<V4L2Decoder> image_decoder_;
 
     void InitializeEncoderCtx(AVCodecContext *&encoder) override;
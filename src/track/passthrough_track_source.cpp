@@ -0,0 +1,32 @@
+#include "track/passthrough_track_source.h"
+
+rtc::scoped_refptr<PassthroughTrackSource>
+PassthroughTrackSource::Create(std::shared_ptr<VideoCapturer> capturer) {
+    auto obj = rtc::make_ref_counted<PassthroughTrackSource>(std::move(capturer));
+    obj->StartTrack();
+    return obj;
+}
+
+PassthroughTrackSource::PassthroughTrackSource(std::shared_ptr<VideoCapturer> capturer)
+    : ScaleTrackSource(capturer) {}
+
+PassthroughTrackSource::~PassthroughTrackSource() {}
+
+void PassthroughTrackSource::Subscribe() {
+    observer->Subscribe([this](rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+        OnFrameCaptured(frame_buffer);
+    });
+}
+
+void PassthroughTrackSource::OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+    const int64_t translated_timestamp_us = TranslateTimestamp(frame_buffer->timestamp());
+
+    // Compressed frames can neither be scaled nor dropped without breaking the GOP, so they are
+    // forwarded as is. The encoder runs on another thread, so it gets a copy of the access unit
+    // and the capture buffer goes back to the driver once the other consumers are done.
+    OnFrame(webrtc::VideoFrame::Builder()
+                .set_video_frame_buffer(frame_buffer->Copy())
+                .set_rotation(webrtc::kVideoRotation_0)
+                .set_timestamp_us(translated_timestamp_us)
+                .build());
+}
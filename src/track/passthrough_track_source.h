@@ -0,0 +1,20 @@
+#ifndef PASSTHROUGH_TRACK_SOURCE_H_
+#define PASSTHROUGH_TRACK_SOURCE_H_
+
+#include "track/scale_track_source.h"
+
+class PassthroughTrackSource : public ScaleTrackSource {
+  public:
+    static rtc::scoped_refptr<PassthroughTrackSource>
+    Create(std::shared_ptr<VideoCapturer> capturer);
+    PassthroughTrackSource(std::shared_ptr<VideoCapturer> capturer);
+    ~PassthroughTrackSource();
+
+  protected:
+    void Subscribe() override;
+
+  private:
+    void OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer);
+};
+
+#endif
@@ -2,12 +2,15 @@
 
 // WebRTC
 #include <api/video/i420_buffer.h>
+#include <rtc_base/time_utils.h>
 #include <third_party/libyuv/include/libyuv.h>
 
 #include "common/logging.h"
 #include "common/v4l2_frame_buffer.h"
 
 static const int kBufferAlignment = 64;
+// Scaling runs off the capture thread when frames hold their buffer, only the newest waits.
+static const int kFrameQueueDepth = 1;
 
 rtc::scoped_refptr<ScaleTrackSource>
 ScaleTrackSource::Create(std::shared_ptr<VideoCapturer> capturer) {
@@ -22,27 +25,58 @@ ScaleTrackSource::ScaleTrackSource(std::shared_ptr<VideoCapturer> capturer)
       height(capturer->height()) {}
 
 ScaleTrackSource::~ScaleTrackSource() {
-    // todo: tell capture unsubscribe observer.
+    if (observer) {
+        observer->UnSubscribe();
+    }
 }
 
-void ScaleTrackSource::StartTrack() {
-    auto observer = capturer->AsFrameBufferObservable();
-    observer->Subscribe([this](rtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer) {
+void ScaleTrackSource::StartTrack() { observer = capturer->AsFrameBufferObservable(); }
+
+void ScaleTrackSource::OnSinkWantsChanged(const rtc::VideoSinkWants &wants) {
+    rtc::AdaptedVideoTrackSource::OnSinkWantsChanged(wants);
+
+    std::lock_guard<std::mutex> lock(subscription_mutex_);
+    if (!observer || wants.is_active == observer->is_subscribed()) {
+        return;
+    }
+    if (wants.is_active) {
+        Subscribe();
+    } else {
+        observer->UnSubscribe();
+    }
+}
+
+void ScaleTrackSource::Subscribe() {
+    auto on_frame = [this](rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
         OnFrameCaptured(frame_buffer);
-    });
+    };
+
+    if (capturer->has_frame_lease()) {
+        observer->Subscribe(on_frame, kFrameQueueDepth);
+    } else {
+        observer->Subscribe(on_frame);
+    }
+}
+
+int64_t ScaleTrackSource::TranslateTimestamp(timeval capture_time) {
+    const int64_t now_us = rtc::TimeMicros();
+    int64_t capture_time_us = capture_time.tv_sec * rtc::kNumMicrosecsPerSec + capture_time.tv_usec;
+    if (capture_time_us <= 0) {
+        // Not stamped by the source, fall back to the arrival time.
+        capture_time_us = now_us;
+    }
+    return timestamp_aligner.TranslateTimestamp(capture_time_us, now_us);
 }
 
-void ScaleTrackSource::OnFrameCaptured(rtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer) {
-    const int64_t timestamp_us = rtc::TimeMicros();
-    const int64_t translated_timestamp_us =
-        timestamp_aligner.TranslateTimestamp(timestamp_us, rtc::TimeMicros());
+void ScaleTrackSource::OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+    const int64_t translated_timestamp_us = TranslateTimestamp(frame_buffer->timestamp());
 
     int adapted_width, adapted_height, crop_width, crop_height, crop_x, crop_y;
     if (capturer->config().fixed_resolution) {
         adapted_width = width;
         adapted_height = height;
-    } else if (!AdaptFrame(width, height, timestamp_us, &adapted_width, &adapted_height,
-                           &crop_width, &crop_height, &crop_x, &crop_y)) {
+    } else if (!AdaptFrame(width, height, translated_timestamp_us, &adapted_width,
+                           &adapted_height, &crop_width, &crop_height, &crop_x, &crop_y)) {
         return;
     }
 
@@ -1,6 +1,8 @@
 #ifndef SCALE_TRACK_SOURCE_H_
 #define SCALE_TRACK_SOURCE_H_
 
+#include <mutex>
+
 #include <media/base/adapted_video_track_source.h>
 #include <rtc_base/timestamp_aligner.h>
 
@@ -22,10 +24,20 @@ class ScaleTrackSource : public rtc::AdaptedVideoTrackSource {
     int width;
     int height;
     std::shared_ptr<VideoCapturer> capturer;
+    std::shared_ptr<Observable<rtc::scoped_refptr<V4L2FrameBuffer>>> observer;
     rtc::TimestampAligner timestamp_aligner;
 
+    // Maps the driver's capture time onto rtc::TimeMicros(), i.e. the frame keeps the sensor's
+    // cadence and delays before the track source do not end up in the RTP timestamps.
+    int64_t TranslateTimestamp(timeval capture_time);
+    // Frames are only taken while a sink is active, so the capturer can tell nobody watches.
+    void OnSinkWantsChanged(const rtc::VideoSinkWants &wants) override;
+    virtual void Subscribe();
+
   private:
-    void OnFrameCaptured(rtc::scoped_refptr<webrtc::VideoFrameBuffer> frame_buffer);
+    std::mutex subscription_mutex_;
+
+    void OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer);
 };
 
 #endif
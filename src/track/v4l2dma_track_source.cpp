@@ -7,8 +7,12 @@
 #include <rtc_base/timestamp_aligner.h>
 #include <third_party/libyuv/include/libyuv.h>
 
+#include "codecs/v4l2/v4l2_encoder.h"
 #include "common/v4l2_utils.h"
 
+// The current size and the adapter's first three steps down.
+static const size_t kMaxScalers = 4;
+
 rtc::scoped_refptr<V4L2DmaTrackSource>
 V4L2DmaTrackSource::Create(std::shared_ptr<VideoCapturer> capturer) {
     auto obj = rtc::make_ref_counted<V4L2DmaTrackSource>(std::move(capturer));
@@ -20,54 +24,76 @@ V4L2DmaTrackSource::V4L2DmaTrackSource(std::shared_ptr<VideoCapturer> capturer)
     : ScaleTrackSource(capturer),
       is_dma_src_(capturer->is_dma_capture()),
       config_width_(capturer->width()),
-      config_height_(capturer->height()) {}
+      config_height_(capturer->height()),
+      is_prewarmed_(false),
+      // An unscaled stream is encoded from mmap buffers, see `V4L2H264Encoder`.
+      scalers_(std::make_unique<V4L2ScalerCache>(width, height, is_dma_src_,
+                                                 !capturer->config().fixed_resolution,
+                                                 kMaxScalers)) {}
 
-V4L2DmaTrackSource::~V4L2DmaTrackSource() { scaler.reset(); }
+V4L2DmaTrackSource::~V4L2DmaTrackSource() { scalers_.reset(); }
 
-void V4L2DmaTrackSource::StartTrack() {
-    auto observer = capturer->AsFrameBufferObservable();
+void V4L2DmaTrackSource::Subscribe() {
     observer->Subscribe([this](rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
-        OnFrameCaptured(frame_buffer->GetRawBuffer());
+        OnFrameCaptured(frame_buffer);
     });
 }
 
-void V4L2DmaTrackSource::OnFrameCaptured(V4L2Buffer decoded_buffer) {
-    const int64_t timestamp_us = rtc::TimeMicros();
-    const int64_t translated_timestamp_us =
-        timestamp_aligner.TranslateTimestamp(timestamp_us, rtc::TimeMicros());
+void V4L2DmaTrackSource::OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer) {
+    const int64_t translated_timestamp_us = TranslateTimestamp(frame_buffer->timestamp());
 
     if (capturer->config().fixed_resolution) {
-        auto dst_buffer = V4L2FrameBuffer::Create(config_width_, config_height_, decoded_buffer,
-                                                  V4L2_PIX_FMT_YUV420);
+        if (!V4L2Encoder::IsSupportedSourceFormat(frame_buffer->format())) {
+            // The encoder cannot take packed formats, let the scaler convert them.
+            Scale(frame_buffer, config_width_, config_height_, translated_timestamp_us);
+            return;
+        }
+
+        if (!frame_buffer->has_lease()) {
+            // The encoder runs later, the driver refills this memory once the callback returns.
+            frame_buffer->CopyBufferData();
+        }
+        // e.g. NV12 goes to the encoder untouched, the frame's lease holds the driver buffer.
         OnFrame(webrtc::VideoFrame::Builder()
-                    .set_video_frame_buffer(dst_buffer)
+                    .set_video_frame_buffer(frame_buffer)
                     .set_rotation(webrtc::kVideoRotation_0)
                     .set_timestamp_us(translated_timestamp_us)
                     .build());
     } else {
         int adapted_width, adapted_height, crop_width, crop_height, crop_x, crop_y;
-        if (!AdaptFrame(width, height, timestamp_us, &adapted_width, &adapted_height, &crop_width,
-                        &crop_height, &crop_x, &crop_y)) {
+        if (!AdaptFrame(width, height, translated_timestamp_us, &adapted_width, &adapted_height,
+                        &crop_width, &crop_height, &crop_x, &crop_y)) {
             return;
         }
 
-        if (!scaler || adapted_width != config_width_ || adapted_height != config_height_) {
-            config_width_ = adapted_width;
-            config_height_ = adapted_height;
-            scaler =
-                V4L2Scaler::Create(width, height, config_width_, config_height_, is_dma_src_, true);
-        }
-
-        scaler->EmplaceBuffer(
-            decoded_buffer, [this, translated_timestamp_us](V4L2Buffer scaled_buffer) {
-                auto dst_buffer = V4L2FrameBuffer::Create(config_width_, config_height_,
-                                                          scaled_buffer, V4L2_PIX_FMT_YUV420);
+        Scale(frame_buffer, adapted_width, adapted_height, translated_timestamp_us);
+    }
+}
 
-                OnFrame(webrtc::VideoFrame::Builder()
-                            .set_video_frame_buffer(dst_buffer)
-                            .set_rotation(webrtc::kVideoRotation_0)
-                            .set_timestamp_us(translated_timestamp_us)
-                            .build());
-            });
+void V4L2DmaTrackSource::Scale(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer, int dst_width,
+                               int dst_height, int64_t timestamp_us) {
+    V4L2Buffer buffer = frame_buffer->GetRawBuffer();
+    const uint32_t format = frame_buffer->format();
+    auto *scaler = scalers_->Get(dst_width, dst_height, format, buffer.stride);
+    if (!is_prewarmed_ && !capturer->config().fixed_resolution) {
+        // The adapter alternates 3/4 and 2/3 steps, i.e. 3/4, 1/2 and 3/8 of the size come first.
+        is_prewarmed_ = true;
+        scalers_->Prewarm({{width * 3 / 4 & ~1, height * 3 / 4 & ~1},
+                           {width / 2 & ~1, height / 2 & ~1},
+                           {width * 3 / 8 & ~1, height * 3 / 8 & ~1}},
+                          format, buffer.stride);
     }
+
+    // The frame, and with it the lease on its buffer, is held until the scaler is done with it.
+    scaler->EmplaceBuffer(buffer, [this, frame_buffer, dst_width, dst_height,
+                                   timestamp_us](V4L2Buffer scaled_buffer) {
+        auto dst_buffer =
+            V4L2FrameBuffer::Create(dst_width, dst_height, scaled_buffer, V4L2_PIX_FMT_YUV420);
+
+        OnFrame(webrtc::VideoFrame::Builder()
+                    .set_video_frame_buffer(dst_buffer)
+                    .set_rotation(webrtc::kVideoRotation_0)
+                    .set_timestamp_us(timestamp_us)
+                    .build());
+    });
 }
@@ -1,7 +1,7 @@
 #ifndef V4L2DMA_TRACK_SOURCE_H_
 #define V4L2DMA_TRACK_SOURCE_H_
 
-#include "codecs/v4l2/v4l2_scaler.h"
+#include "codecs/v4l2/v4l2_scaler_cache.h"
 #include "track/scale_track_source.h"
 
 class V4L2DmaTrackSource : public ScaleTrackSource {
@@ -9,15 +9,20 @@ class V4L2DmaTrackSource : public ScaleTrackSource {
     static rtc::scoped_refptr<V4L2DmaTrackSource> Create(std::shared_ptr<VideoCapturer> capturer);
     V4L2DmaTrackSource(std::shared_ptr<VideoCapturer> capturer);
     ~V4L2DmaTrackSource();
-    void StartTrack() override;
+
+  protected:
+    void Subscribe() override;
 
   private:
     bool is_dma_src_;
     int config_width_;
     int config_height_;
-    std::unique_ptr<V4L2Scaler> scaler;
+    bool is_prewarmed_;
+    std::unique_ptr<V4L2ScalerCache> scalers_;
 
-    void OnFrameCaptured(V4L2Buffer buffer);
+    void OnFrameCaptured(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer);
+    void Scale(rtc::scoped_refptr<V4L2FrameBuffer> frame_buffer, int dst_width, int dst_height,
+               int64_t timestamp_us);
 };
 
 #endif
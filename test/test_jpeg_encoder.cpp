@@ -0,0 +1,59 @@
+#include "codecs/jpeg/jpeg_encoder.h"
+
+#include <api/video/i420_buffer.h>
+#include <chrono>
+#include <string>
+
+/* Usage: test_jpeg_encoder [device] [width] [height] [fwht]
+ * e.g. `test_jpeg_encoder /dev/video31 1920 1080` on a Pi, or against vicodec loaded with
+ * `modprobe vicodec multiplanar=1`: `test_jpeg_encoder /dev/videoN 640 480 fwht`.
+ * With a device given, falling back to software is a failure. */
+int main(int argc, char *argv[]) {
+    const bool is_device_required = argc > 1;
+    const char *device = is_device_required ? argv[1] : V4L2JpegEncoder::kDefaultFile;
+    int width = argc > 2 ? std::stoi(argv[2]) : 1280;
+    int height = argc > 3 ? std::stoi(argv[3]) : 720;
+    bool is_fwht = argc > 4 && std::string(argv[4]) == "fwht";
+    uint32_t dst_pix_fmt = is_fwht ? v4l2_fourcc('F', 'W', 'H', 'T') : V4L2_PIX_FMT_JPEG;
+
+    auto i420_buffer = webrtc::I420Buffer::Create(width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            i420_buffer->MutableDataY()[y * i420_buffer->StrideY() + x] = x * 255 / width;
+        }
+    }
+    for (int y = 0; y < (height + 1) / 2; y++) {
+        for (int x = 0; x < (width + 1) / 2; x++) {
+            i420_buffer->MutableDataU()[y * i420_buffer->StrideU() + x] = y * 510 / height;
+            i420_buffer->MutableDataV()[y * i420_buffer->StrideV() + x] = 128;
+        }
+    }
+
+    auto encoder = JpegEncoder::Create(device, dst_pix_fmt);
+    printf("Encoding %dx%d in %s\n", width, height, encoder->is_hardware() ? device : "software");
+    if (is_device_required && !encoder->is_hardware()) {
+        printf("%s cannot encode, the software fallback does not count\n", device);
+        return 1;
+    }
+
+    for (int i = 0; i < 10; i++) {
+        auto start = std::chrono::steady_clock::now();
+        auto buffer = encoder->Encode(i420_buffer, 30 + i * 7);
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        printf("Image %d: %lu bytes in %lld us\n", i, buffer.length, (long long)elapsed.count());
+        if (!buffer.start || buffer.length == 0) {
+            printf("Encoding failed\n");
+            return 1;
+        }
+        if (i == 0 && !is_fwht) {
+            Utils::WriteJpegImage(std::move(buffer), "test_jpeg_encoder.jpg");
+        }
+    }
+
+    if (is_device_required && !encoder->is_hardware()) {
+        printf("%s kept failing, the encoder fell back to software\n", device);
+        return 1;
+    }
+    return 0;
+}